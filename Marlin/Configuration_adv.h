@@ -2426,6 +2426,13 @@
 // :[0, 2, 4, 8, 16, 32, 64, 128, 256]
 #define TX_BUFFER_SIZE 0
 
+// STM32 only. Never wait on the port to write a log: once the TX buffer is 3/4 full,
+// low priority output is dropped a line at a time, and the rest of the buffer is kept
+// for the high priority output (see MarlinSerial::set_tx_high_priority).
+// The size of the buffer is SERIAL_TX_BUFFER_SIZE, set in the build flags of the env
+// since TX_BUFFER_SIZE is limited to 256.
+#define SERIAL_TX_LOW_PRIORITY
+
 // Host Receive Buffer Size
 // Without XON/XOFF flow control (see SERIAL_XON_XOFF below) 32 bytes should be enough.
 // To use flow control, set this buffer size to at least 1024 bytes.
@@ -11,6 +11,15 @@ void Boiler::setup() {
     pinMode(Pin::WaterLevelAlarm, INPUT_PULLUP);
     m_should_wait_for_boiler_to_fill = is_alarm_triggered();
     m_storage_handle = storage::register_handle_for_entry("temp", sizeof(m_target_temperature));
+
+    m_gains_storage_handle = storage::register_handle_for_entry("pid", sizeof(StoredGains));
+    if (auto entry = storage::fetch_entry(m_gains_storage_handle)) {
+        const auto stored = entry->read_binary<StoredGains>();
+        if (stored.version == GAINS_STORAGE_VERSION) {
+            m_tuned_gains = stored;
+            apply_gains(stored.gains);
+        }
+    }
 }
 
 static void filling_event(bool b) {
@@ -46,6 +55,7 @@ static void wait_for_boiler_to_fill() {
 
 void Boiler::tick() {
     if (CFG(MaintenanceMode)) {
+        thermalManager.hotend_feed_forward = m_feed_forward = 0.f;
         every(5s) {
             LOG("ALARME: ", is_alarm_triggered());
         }
@@ -59,6 +69,10 @@ void Boiler::tick() {
         if (not CFG(GigaMode))
             security_checks();
 
+        // while tuning the output of the resistance belongs to the relay
+        if (not m_tuning)
+            update_feed_forward();
+
         if (m_target_temperature) {
             every(5s) {
                 inform_temperature_to_host();
@@ -84,9 +98,17 @@ bool Boiler::is_in_coffee_making_temperature_range() const {
     return util::is_within(temperature(), range_below, range_above);
 }
 
+// the state of the boiler is read when the event is written, so only the latest of each of these is ever queued
+enum EventKey : u16 {
+    TemperatureEvent = 0,
+    AutotuneEvent,
+};
+
 void Boiler::inform_temperature_to_host() {
-    info::send(
+    info::post(
         info::Event::Boiler,
+        info::Priority::Telemetry,
+        TemperatureEvent,
         [this](JsonObject o) {
             if (m_target_temperature)
                 o["reachingTargetTemp"] = m_reaching_target_temp ?: not is_in_coffee_making_temperature_range();
@@ -98,6 +120,89 @@ void Boiler::inform_temperature_to_host() {
         });
 }
 
+void Boiler::inform_autotune_to_host() {
+    info::post(
+        info::Event::Boiler,
+        info::Priority::Telemetry,
+        AutotuneEvent,
+        [this](JsonObject o) {
+            o["tuning"] = m_tuning;
+            if (m_tuning)
+                o["tuningProgress"] = util::normalize(m_autotune_cycles, 0, RelayAutotune::NUMBER_OF_CYCLES);
+
+            if (m_tuned_gains) {
+                auto pid = o.createNestedObject("pid");
+                pid["kp"] = m_tuned_gains->gains.kp;
+                pid["ki"] = m_tuned_gains->gains.ki;
+                pid["kd"] = m_tuned_gains->gains.kd;
+                pid["target"] = m_tuned_gains->target_temperature;
+            }
+        });
+}
+
+bool Boiler::autotune() {
+    if (CFG(GigaMode) or not m_target_temperature)
+        return false;
+
+    LOG_IF(LogCalibration, "iniciando autotune do boiler - [target = ", m_target_temperature, "]");
+
+    const auto target = m_target_temperature;
+    RelayAutotune tuner{ target - AUTOTUNE_SETPOINT_OFFSET, PID_MAX };
+
+    m_tuning = true;
+    m_abort_autotune = false;
+    m_autotune_cycles = 0;
+    inform_autotune_to_host();
+
+    thermalManager.hotend_open_loop = true;
+    const auto timeout = util::Timer::started();
+    util::idle_until([&] {
+        thermalManager.hotend_feed_forward = tuner.update(temperature(), millis());
+        if (tuner.cycles() != m_autotune_cycles) {
+            m_autotune_cycles = tuner.cycles();
+            inform_autotune_to_host();
+        }
+
+        return tuner.finished() or m_abort_autotune or m_target_temperature != target or
+               timeout >= AUTOTUNE_TIMEOUT or temperature() >= target + AUTOTUNE_MAX_OVERSHOOT;
+    });
+    thermalManager.hotend_open_loop = false;
+    thermalManager.hotend_feed_forward = m_feed_forward = 0.f;
+
+    m_tuning = false;
+
+    const auto gains = tuner.gains();
+    if (gains) {
+        m_autotune_requested = false;
+        m_tuned_gains = StoredGains{ .version = GAINS_STORAGE_VERSION, .target_temperature = target, .gains = *gains };
+        apply_gains(*gains);
+
+        auto entry = storage::fetch_or_create_entry(m_gains_storage_handle);
+        entry.write_binary(*m_tuned_gains);
+
+        LOG_IF(LogCalibration, "autotune do boiler finalizado - [kp = ", gains->kp, " | ki = ", gains->ki, " | kd = ", gains->kd, "]");
+    } else if (m_abort_autotune or m_target_temperature != target) {
+        LOG_IF(LogCalibration, "autotune do boiler cancelado");
+    } else {
+        m_autotune_requested = false;
+        m_autotune_failed = true;
+        LOG_ERR("autotune do boiler falhou - [ciclos = ", tuner.cycles(), " | temperatura = ", temperature(), "]");
+    }
+
+    m_abort_autotune = false;
+    inform_autotune_to_host();
+
+    // the relay leaves the boiler anywhere around the target
+    if (m_target_temperature == target)
+        thermalManager.wait_for_hotend(0, false);
+
+    return gains.has_value();
+}
+
+void Boiler::apply_gains(const RelayAutotune::Gains& gains) {
+    thermalManager.setPID(0, gains.kp, gains.ki, gains.kd);
+}
+
 void Boiler::update_and_reach_target_temperature(std::optional<s32> target) {
     if (target == m_target_temperature)
         return;
@@ -129,6 +234,7 @@ void Boiler::update_target_temperature(std::optional<s32> target) {
     if (target == 0) {
         // when resetting the target temp we don't save it to the storage
         m_target_temperature = 0;
+        thermalManager.hotend_feed_forward = m_feed_forward = 0.f;
         thermalManager.disable_all_heaters();
     } else {
         m_target_temperature = storage::create_or_update_entry(m_storage_handle, target, 94);
@@ -174,6 +280,52 @@ void Boiler::control_temperature() {
     }
 }
 
+void Boiler::update_feed_forward() {
+    auto feed_forward = 0.f;
+    if (CFG(BoilerFeedForward) and not CFG(GigaMode) and m_target_temperature and
+        temperature() < m_target_temperature + PREHEAT_MARGIN) {
+        const auto now = millis();
+        const auto power = energy_drawn_between(now, now + FEED_FORWARD_WINDOW) / (FEED_FORWARD_WINDOW / 1000.f);
+        feed_forward = std::min(power / RESISTANCE_POWER, 1.f) * PID_MAX;
+    }
+
+    if (feed_forward != m_feed_forward) {
+        if ((feed_forward == 0.f) != (m_feed_forward == 0.f))
+            LOG_IF(LogCalibration, "feed forward do boiler ", feed_forward ? "ligado" : "desligado", " - [pwm = ", feed_forward, "]");
+
+        m_feed_forward = feed_forward;
+        thermalManager.hotend_feed_forward = feed_forward;
+    }
+}
+
+f32 Boiler::energy_drawn_between(millis_t begin, millis_t end) const {
+    const auto degrees_to_heat = std::max(m_target_temperature - INLET_TEMPERATURE, 0.f);
+
+    auto volume = 0.f;
+    RecipeQueue::the().for_each_mapped_recipe([&](const Recipe& recipe) {
+        recipe.for_each_remaining_step([&](const Recipe::Step& step) {
+            if (step.starting_tick >= end)
+                return util::Iter::Continue;
+
+            const auto step_volume = std::visit([](const auto& params) { return params.volume_of_water; }, step.command);
+            if (step.starting_tick == 0 or step.duration == 0 or step_volume == 0.f)
+                return util::Iter::Continue;
+
+            // the water is taken as drawn evenly along the step, so only the part within the window counts
+            const auto overlap_begin = std::max(step.starting_tick, begin);
+            const auto overlap_end = std::min(step.ending_tick(), end);
+            if (overlap_end > overlap_begin)
+                volume += step_volume * f32(overlap_end - overlap_begin) / f32(step.duration);
+
+            return util::Iter::Continue;
+        });
+        return util::Iter::Continue;
+    });
+
+    // a ml of water weighs about a gram
+    return volume * WATER_SPECIFIC_HEAT * degrees_to_heat;
+}
+
 void Boiler::security_checks() {
     static auto alarm_triggered_timer = util::Timer::started();
     alarm_triggered_timer.toggle_based_on(is_alarm_triggered());
@@ -4,6 +4,7 @@
 #include <lucas/core/core.h>
 #include <lucas/storage/storage.h>
 #include <lucas/util/Singleton.h>
+#include <lucas/RelayAutotune.h>
 
 namespace lucas {
 class Boiler : public util::Singleton<Boiler> {
@@ -33,16 +34,59 @@ public:
 
     bool is_in_coffee_making_temperature_range() const;
 
+    // identifies the boiler with a relay around the target temperature and keeps the gains that come from it, blocking until it's done
+    // returns false if it failed or was aborted, in which case the gains stay the same
+    bool autotune();
+
+    void abort_autotune() { m_abort_autotune = true; }
+
+    // the gains were never tuned for this boiler, or the host asked for them to be tuned again
+    // a tune that fails isn't tried again on its own until the machine restarts, it takes too long for that
+    bool needs_autotune() const { return not m_autotune_failed and (m_autotune_requested or not m_tuned_gains); }
+
+    void request_autotune() {
+        m_autotune_requested = true;
+        m_autotune_failed = false;
+    }
+
+    bool is_tuning() const { return m_tuning; }
+
     static void inform_temperature_status() {
         core::inform_calibration_status();
         the().inform_temperature_to_host();
     }
 
+    static void inform_autotune_status() {
+        core::inform_calibration_status();
+        the().inform_autotune_to_host();
+    }
+
+    // the layout in which the tuned gains are saved, the version changes whenever it does
+    struct StoredGains {
+        u16 version = 0;
+        // the one the boiler was tuned at
+        s32 target_temperature = 0;
+        RelayAutotune::Gains gains = {};
+    };
+
+    static constexpr u16 GAINS_STORAGE_VERSION = 1;
+
 private:
     void inform_temperature_to_host();
 
+    void inform_autotune_to_host();
+
+    void apply_gains(const RelayAutotune::Gains&);
+
     void security_checks();
 
+    // hands the pid of the resistance the power that the pours scheduled in the queue are about to take
+    // averaged over a window ahead of now, so the boiler starts heating before a big pour instead of sagging during it
+    void update_feed_forward();
+
+    // in J, what it takes to heat the water that the mapped steps draw between `begin` and `end`
+    f32 energy_drawn_between(millis_t begin, millis_t end) const;
+
     void control_temperature();
 
     struct ModulateResistanceParams {
@@ -69,6 +113,22 @@ private:
     s32 m_target_temperature = 0;
 
     storage::Handle m_storage_handle;
+    storage::Handle m_gains_storage_handle;
+
+    std::optional<StoredGains> m_tuned_gains;
+    bool m_autotune_requested = false;
+    bool m_autotune_failed = false;
+    bool m_abort_autotune = false;
+    bool m_tuning = false;
+    usize m_autotune_cycles = 0;
+
+    // the relay oscillates around this much below the target, so the boiler barely goes above it while being tuned
+    static constexpr f32 AUTOTUNE_SETPOINT_OFFSET = 1.f;
+
+    // the tune is given up if the boiler goes this much above the target
+    static constexpr f32 AUTOTUNE_MAX_OVERSHOOT = 6.f;
+
+    static constexpr auto AUTOTUNE_TIMEOUT = 45min;
 
     bool m_reaching_target_temp = false;
 
@@ -78,5 +138,24 @@ private:
     util::Timer m_heating_check_timer;
 
     util::Timer m_outside_target_range_timer;
+
+    // in the units of the pid output, between 0 and `PID_MAX`
+    f32 m_feed_forward = 0.f;
+
+    // how far ahead the scheduled pours are looked at, roughly how long the boiler takes to recover from one
+    static constexpr millis_t FEED_FORWARD_WINDOW = 30000;
+
+    // the feed forward may push the temperature this much above the target, since the pour coming is going to pull it down
+    // it has to stay within the top of `is_in_coffee_making_temperature_range`
+    static constexpr f32 PREHEAT_MARGIN = 1.f;
+
+    // in W
+    static constexpr f32 RESISTANCE_POWER = 1500.f;
+
+    // in celsius, the water comes from a reservoir at room temperature
+    static constexpr f32 INLET_TEMPERATURE = 25.f;
+
+    // in J/(g * celsius)
+    static constexpr f32 WATER_SPECIFIC_HEAT = 4.186f;
 };
 }
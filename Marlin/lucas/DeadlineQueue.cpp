@@ -0,0 +1,69 @@
+#include "DeadlineQueue.h"
+#include <lucas/lucas.h>
+
+namespace lucas {
+// std::*_heap build a max-heap, so the comparison is flipped to keep the earliest deadline on top
+static bool later(const DeadlineQueue::Deadline& a, const DeadlineQueue::Deadline& b) {
+    return a.tick > b.tick;
+}
+
+void DeadlineQueue::schedule(const Deadline& deadline) {
+    if (m_heap.is_full()) {
+        LOG_ERR("fila de prazos cheia - [estacao = ", deadline.station, "]");
+        return;
+    }
+
+    m_heap.push_back(deadline);
+    std::push_heap(m_heap.begin(), m_heap.end(), later);
+}
+
+void DeadlineQueue::remove(usize station) {
+    m_heap.erase_if([station](const Deadline& d) {
+        return d.station == station;
+    });
+    std::make_heap(m_heap.begin(), m_heap.end(), later);
+}
+
+void DeadlineQueue::clear() {
+    m_heap.clear();
+}
+
+std::optional<DeadlineQueue::Deadline> DeadlineQueue::pop_due() {
+    if (m_heap.is_empty() or m_heap[0].tick > millis())
+        return std::nullopt;
+
+    std::pop_heap(m_heap.begin(), m_heap.end(), later);
+    const auto deadline = m_heap[m_heap.size() - 1];
+    m_heap.pop_back();
+    return deadline;
+}
+
+std::optional<DeadlineQueue::Deadline> DeadlineQueue::pop_due(Kind kind) {
+    const auto tick = millis();
+    auto earliest = m_heap.end();
+    for (auto it = m_heap.begin(); it != m_heap.end(); ++it) {
+        if (it->kind == kind and it->tick <= tick and (earliest == m_heap.end() or it->tick < earliest->tick))
+            earliest = it;
+    }
+
+    if (earliest == m_heap.end())
+        return std::nullopt;
+
+    const auto deadline = *earliest;
+    m_heap.erase(earliest);
+    std::make_heap(m_heap.begin(), m_heap.end(), later);
+    return deadline;
+}
+
+void DeadlineQueue::record_dispatch(millis_t lateness, bool missed) {
+    ++m_dispatch_stats.dispatched;
+    m_dispatch_stats.missed += missed;
+    m_dispatch_stats.total_lateness += lateness;
+    m_dispatch_stats.max_lateness = std::max(m_dispatch_stats.max_lateness, lateness);
+}
+
+void DeadlineQueue::record_delay(millis_t absorbed, millis_t propagated) {
+    m_dispatch_stats.absorbed_delay += absorbed;
+    m_dispatch_stats.propagated_delay += propagated;
+}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <lucas/Station.h>
+#include <lucas/util/StaticVector.h>
+#include <optional>
+
+namespace lucas {
+// the upcoming events of the recipe queue, ordered by the tick in which they're due
+// only the earliest one has to be compared against millis() on every tick of the queue
+class DeadlineQueue {
+public:
+    enum class Kind {
+        // the spout should start travelling to the station
+        Travel = 0,
+        // the current step of the station's recipe should start
+        Step,
+        // the pump should start ahead of the current step, so the water reaches the coffee right as its pattern begins
+        Pour,
+    };
+
+    struct Deadline {
+        millis_t tick = 0;
+        usize station = Station::INVALID;
+        Kind kind = Kind::Step;
+    };
+
+    struct DispatchStats {
+        usize dispatched = 0;
+        // steps that were so late they had to be compensated
+        usize missed = 0;
+        millis_t total_lateness = 0;
+        millis_t max_lateness = 0;
+        // how much of the delay caused by missed steps was absorbed by idle time, and how much was passed on to other recipes
+        millis_t absorbed_delay = 0;
+        millis_t propagated_delay = 0;
+    };
+
+    void schedule(const Deadline&);
+
+    void remove(usize station);
+
+    void clear();
+
+    // pops the earliest deadline, if it's already due
+    std::optional<Deadline> pop_due();
+
+    // pops the earliest deadline of `kind` that's already due, even if others are due before it
+    std::optional<Deadline> pop_due(Kind kind);
+
+    void record_dispatch(millis_t lateness, bool missed);
+
+    void record_delay(millis_t absorbed, millis_t propagated);
+
+    const DispatchStats& dispatch_stats() const { return m_dispatch_stats; }
+
+    void reset_dispatch_stats() { m_dispatch_stats = {}; }
+
+    bool is_empty() const { return m_heap.is_empty(); }
+
+    // every station has at most one travel, one pour and one step pending
+    static constexpr usize MAX_DEADLINES = Station::MAXIMUM_NUMBER_OF_STATIONS * 3;
+
+private:
+    util::StaticVector<Deadline, MAX_DEADLINES> m_heap;
+
+    DispatchStats m_dispatch_stats;
+};
+}
@@ -0,0 +1,164 @@
+#include "FlowCurve.h"
+#include <algorithm>
+#include <cmath>
+
+namespace lucas {
+FlowCurve FlowCurve::from_samples(std::span<const FlowModel::Sample> samples) {
+    util::StaticVector<FlowModel::Sample, MAX_SAMPLES> sorted;
+    for (const auto& sample : samples) {
+        if (sorted.is_full())
+            break;
+        sorted.push_back(sample);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.flow < b.flow;
+    });
+
+    // pool adjacent violators: whenever a sample asks for less signal than the one before it (or has the same flow) both are merged into their average
+    // what's left is the closest non-decreasing curve to the samples, in the least squares sense
+    struct Block {
+        f64 flow = 0.;
+        f64 digital_signal = 0.;
+        usize count = 0;
+
+        f64 mean_flow() const { return flow / count; }
+        f64 mean_signal() const { return digital_signal / count; }
+    };
+
+    util::StaticVector<Block, MAX_SAMPLES> blocks;
+    for (const auto& sample : sorted) {
+        blocks.push_back({ sample.flow, f64(sample.digital_signal), 1 });
+        while (blocks.size() >= 2) {
+            auto& previous = blocks[blocks.size() - 2];
+            const auto& last = blocks[blocks.size() - 1];
+            if (previous.mean_signal() <= last.mean_signal() and previous.mean_flow() < last.mean_flow())
+                break;
+
+            previous.flow += last.flow;
+            previous.digital_signal += last.digital_signal;
+            previous.count += last.count;
+            blocks.pop_back();
+        }
+    }
+
+    FlowCurve curve;
+    util::StaticVector<Knot, MAX_SAMPLES> knots;
+    for (const auto& block : blocks)
+        knots.push_back({ f32(block.mean_flow()), u32(std::round(block.mean_signal())) });
+
+    // the error of dropping a knot is how far it is from the segment between its neighbours
+    const auto error_of_dropping = [&knots](usize i) {
+        const auto& before = knots[i - 1];
+        const auto& after = knots[i + 1];
+        const auto t = (knots[i].flow - before.flow) / (after.flow - before.flow);
+        const auto interpolated = std::lerp(f32(before.digital_signal), f32(after.digital_signal), t);
+        return std::abs(interpolated - f32(knots[i].digital_signal));
+    };
+
+    while (knots.size() > MAX_KNOTS) {
+        usize best = 1;
+        for (usize i = 2; i + 1 < knots.size(); ++i) {
+            if (error_of_dropping(i) < error_of_dropping(best))
+                best = i;
+        }
+        knots.erase(std::next(knots.begin(), best));
+    }
+
+    for (const auto& knot : knots)
+        curve.m_knots.push_back(knot);
+    return curve;
+}
+
+FlowCurve FlowCurve::blend(const FlowCurve& a, const FlowCurve& b, f32 t) {
+    if (a.is_empty() or b.is_empty())
+        return a.is_empty() ? b : a;
+
+    const auto min_flow = std::max(a.min_flow(), b.min_flow());
+    const auto max_flow = std::min(a.max_flow(), b.max_flow());
+    if (min_flow >= max_flow)
+        return t < 0.5f ? a : b;
+
+    // the knots of both curves are kept, so neither loses its shape
+    util::StaticVector<FlowModel::Sample, MAX_KNOTS * 2 + 2> samples;
+    const auto add_sample = [&](f32 flow) {
+        const auto digital_signal = std::lerp(a.signal_for(flow), b.signal_for(flow), t);
+        samples.push_back({ flow, u32(std::round(std::max(digital_signal, 0.f))) });
+    };
+
+    add_sample(min_flow);
+    for (const auto& curve : { &a, &b }) {
+        for (const auto& knot : *curve) {
+            if (knot.flow > min_flow and knot.flow < max_flow)
+                add_sample(knot.flow);
+        }
+    }
+    add_sample(max_flow);
+
+    return from_samples(std::span{ samples.begin(), samples.end() });
+}
+
+f32 FlowCurve::signal_for(f32 flow) const {
+    if (is_empty())
+        return 0.f;
+    if (size() == 1)
+        return f32(m_knots[0].digital_signal);
+
+    // the segment that contains the flow, or the closest one to it
+    auto it = std::upper_bound(begin(), end(), flow, [](f32 flow, const Knot& knot) {
+        return flow < knot.flow;
+    });
+    it = std::clamp(it, std::next(begin()), std::prev(end()));
+
+    const auto& before = *std::prev(it);
+    const auto& after = *it;
+    const auto t = (flow - before.flow) / (after.flow - before.flow);
+    return std::lerp(f32(before.digital_signal), f32(after.digital_signal), t);
+}
+
+f32 FlowCurve::flow_for(f32 digital_signal) const {
+    if (is_empty())
+        return 0.f;
+    if (size() == 1)
+        return m_knots[0].flow;
+
+    auto it = std::upper_bound(begin(), end(), digital_signal, [](f32 digital_signal, const Knot& knot) {
+        return digital_signal < f32(knot.digital_signal);
+    });
+    it = std::clamp(it, std::next(begin()), std::prev(end()));
+
+    const auto& before = *std::prev(it);
+    const auto& after = *it;
+    // the signal is only non-decreasing, a flat segment gives the lowest flow that matches
+    if (after.digital_signal == before.digital_signal)
+        return before.flow;
+
+    const auto t = (digital_signal - f32(before.digital_signal)) / f32(after.digital_signal - before.digital_signal);
+    return std::max(std::lerp(before.flow, after.flow, t), 0.f);
+}
+
+FlowCurve::Stored FlowCurve::to_stored() const {
+    Stored stored;
+    stored.version = STORAGE_VERSION;
+    stored.number_of_knots = u16(size());
+    std::copy(begin(), end(), stored.knots.begin());
+    return stored;
+}
+
+std::optional<FlowCurve> FlowCurve::from_stored(const Stored& stored) {
+    if (stored.version != STORAGE_VERSION or stored.number_of_knots > MAX_KNOTS)
+        return std::nullopt;
+
+    FlowCurve curve;
+    for (usize i = 0; i < stored.number_of_knots; ++i) {
+        const auto& knot = stored.knots[i];
+        // a curve that isn't monotone would break the binary searches
+        if (i > 0) {
+            const auto& previous = stored.knots[i - 1];
+            if (knot.flow <= previous.flow or knot.digital_signal < previous.digital_signal)
+                return std::nullopt;
+        }
+        curve.m_knots.push_back(knot);
+    }
+    return curve;
+}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <lucas/FlowModel.h>
+#include <lucas/util/StaticVector.h>
+#include <span>
+
+namespace lucas {
+// the digital signal that produces each flow, as a monotone piecewise linear curve through a few knots
+// both directions are a binary search followed by a lerp, so any flow (or signal) can be looked up, not just the ones that were measured
+class FlowCurve {
+public:
+    struct Knot {
+        f32 flow = 0.f;
+        u32 digital_signal = 0;
+    };
+
+    // the samples can come in any order and don't even need to be monotone, the ones that go against it are averaged together
+    // the result is thinned down to `MAX_KNOTS` by dropping the knots that change the curve the least
+    static FlowCurve from_samples(std::span<const FlowModel::Sample>);
+
+    // a curve between two others, `t` going from 0 at `a` to 1 at `b`
+    // it only covers the flows both of them cover, since that's where they can be compared
+    static FlowCurve blend(const FlowCurve& a, const FlowCurve& b, f32 t);
+
+    // both extrapolate with the slope of the closest segment
+    f32 signal_for(f32 flow) const;
+    f32 flow_for(f32 digital_signal) const;
+
+    bool is_empty() const { return m_knots.is_empty(); }
+
+    usize size() const { return m_knots.size(); }
+
+    void clear() { m_knots.clear(); }
+
+    f32 min_flow() const { return is_empty() ? 0.f : m_knots[0].flow; }
+    f32 max_flow() const { return is_empty() ? 0.f : m_knots[m_knots.size() - 1].flow; }
+
+    auto begin() const { return m_knots.begin(); }
+    auto end() const { return m_knots.end(); }
+
+    static constexpr usize MAX_KNOTS = 32;
+
+    // the most samples `from_samples` takes, anything past that is ignored
+    static constexpr usize MAX_SAMPLES = 128;
+
+    // the layout in which the curve is saved, the version changes whenever it does
+    struct Stored {
+        u16 version = 0;
+        u16 number_of_knots = 0;
+        std::array<Knot, MAX_KNOTS> knots = {};
+    };
+
+    static constexpr u16 STORAGE_VERSION = 1;
+
+    Stored to_stored() const;
+
+    // returns nothing if the stored curve is from another version or doesn't make sense
+    static std::optional<FlowCurve> from_stored(const Stored&);
+
+private:
+    util::StaticVector<Knot, MAX_KNOTS> m_knots;
+};
+}
@@ -0,0 +1,110 @@
+#include "FlowCurveCache.h"
+#include <algorithm>
+
+namespace lucas {
+bool FlowCurveCache::load(const Stored& stored) {
+    const auto same_version = stored.version == STORAGE_VERSION;
+    if (same_version)
+        m_stored = stored;
+    else
+        m_stored = {};
+
+    m_stored.version = STORAGE_VERSION;
+    ++m_stored.session;
+    return same_version;
+}
+
+std::optional<FlowCurveCache::Lookup> FlowCurveCache::find(s32 target_temperature, bool trust_previous_sessions, bool interpolate) const {
+    const Slot* below = nullptr;
+    const Slot* above = nullptr;
+    for (const auto& slot : m_stored.slots) {
+        if (not is_usable(slot, trust_previous_sessions))
+            continue;
+
+        if (slot.target_temperature == target_temperature) {
+            if (auto curve = FlowCurve::from_stored(slot.curve))
+                return Lookup{ *curve, Match::Exact };
+        } else if (slot.target_temperature < target_temperature) {
+            if (not below or slot.target_temperature > below->target_temperature)
+                below = &slot;
+        } else {
+            if (not above or slot.target_temperature < above->target_temperature)
+                above = &slot;
+        }
+    }
+
+    if (not interpolate or not below or not above)
+        return std::nullopt;
+    if (above->target_temperature - below->target_temperature > MAX_INTERPOLATION_GAP)
+        return std::nullopt;
+
+    const auto curve_below = FlowCurve::from_stored(below->curve);
+    const auto curve_above = FlowCurve::from_stored(above->curve);
+    if (not curve_below or not curve_above)
+        return std::nullopt;
+
+    const auto t = f32(target_temperature - below->target_temperature) / f32(above->target_temperature - below->target_temperature);
+    return Lookup{ FlowCurve::blend(*curve_below, *curve_above, t), Match::Interpolated };
+}
+
+void FlowCurveCache::store(s32 target_temperature, const FlowCurve& curve) {
+    auto& slot = slot_to_replace(target_temperature);
+    slot.target_temperature = target_temperature;
+    slot.session = m_stored.session;
+    slot.sequence = ++m_stored.sequence;
+    slot.valid = true;
+    slot.curve = curve.to_stored();
+}
+
+void FlowCurveCache::store_from_previous_session(s32 target_temperature, const FlowCurve& curve) {
+    store(target_temperature, curve);
+    slot_to_replace(target_temperature).session = m_stored.session - 1;
+}
+
+void FlowCurveCache::invalidate(s32 target_temperature) {
+    for (auto& slot : m_stored.slots) {
+        if (slot.target_temperature == target_temperature)
+            slot.valid = false;
+    }
+}
+
+void FlowCurveCache::invalidate_all() {
+    for (auto& slot : m_stored.slots)
+        slot.valid = false;
+}
+
+usize FlowCurveCache::number_of_valid_slots() const {
+    return std::count_if(m_stored.slots.begin(), m_stored.slots.end(), [](const Slot& slot) {
+        return slot.valid;
+    });
+}
+
+const FlowCurveCache::Slot* FlowCurveCache::slot_for(s32 target_temperature) const {
+    for (const auto& slot : m_stored.slots) {
+        if (slot.valid and slot.target_temperature == target_temperature)
+            return &slot;
+    }
+    return nullptr;
+}
+
+bool FlowCurveCache::is_usable(const Slot& slot, bool trust_previous_sessions) const {
+    if (not slot.valid)
+        return false;
+    if (slot.session == m_stored.session)
+        return true;
+
+    return trust_previous_sessions and m_stored.session - slot.session <= MAX_AGE_IN_SESSIONS;
+}
+
+FlowCurveCache::Slot& FlowCurveCache::slot_to_replace(s32 target_temperature) {
+    if (auto slot = slot_for(target_temperature))
+        return const_cast<Slot&>(*slot);
+
+    // an invalid slot has nothing worth keeping, otherwise the one that was analysed the longest ago goes
+    return *std::min_element(m_stored.slots.begin(), m_stored.slots.end(), [](const Slot& a, const Slot& b) {
+        if (a.valid != b.valid)
+            return not a.valid;
+        return a.sequence < b.sequence;
+    });
+}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <lucas/FlowCurve.h>
+#include <lucas/types.h>
+#include <array>
+#include <optional>
+
+namespace lucas {
+// the flow curves of the last few boiler temperatures, so going back to a temperature that was already analysed doesn't need another analysis
+// every slot remembers the power cycle (session) it was analysed in, since the pump only behaves the same while the water in the hose is still warm
+class FlowCurveCache {
+public:
+    struct Slot {
+        s32 target_temperature = 0;
+        u32 session = 0;
+        // increases with every analysis, the slot with the lowest one is the first to be replaced
+        u32 sequence = 0;
+        bool valid = false;
+        FlowCurve::Stored curve = {};
+    };
+
+    static constexpr usize NUMBER_OF_SLOTS = 6;
+
+    // the layout in which the cache is saved, the version changes whenever it does
+    struct Stored {
+        u16 version = 0;
+        u32 session = 0;
+        u32 sequence = 0;
+        std::array<Slot, NUMBER_OF_SLOTS> slots = {};
+    };
+
+    static constexpr u16 STORAGE_VERSION = 1;
+
+    // analyses from older sessions than this are never trusted, no matter how warm the water is
+    static constexpr u32 MAX_AGE_IN_SESSIONS = 30;
+
+    // the widest gap between two temperatures that still gets interpolated, in celsius
+    static constexpr s32 MAX_INTERPOLATION_GAP = 6;
+
+    // starts a new session on top of whatever was stored, returns false if the stored cache was from another version
+    bool load(const Stored&);
+
+    Stored to_stored() const { return m_stored; }
+
+    enum class Match {
+        Exact,
+        Interpolated,
+    };
+
+    struct Lookup {
+        FlowCurve curve;
+        Match match;
+    };
+
+    // the analyses from the current session are always trusted, the ones from previous sessions only when `trust_previous_sessions` is set
+    std::optional<Lookup> find(s32 target_temperature, bool trust_previous_sessions, bool interpolate) const;
+
+    // replaces the slot with the same temperature, or the oldest one when there's none
+    void store(s32 target_temperature, const FlowCurve&);
+
+    // stores an analysis that was made before this session, like the ones migrated from older firmwares
+    void store_from_previous_session(s32 target_temperature, const FlowCurve&);
+
+    void invalidate(s32 target_temperature);
+    void invalidate_all();
+
+    usize number_of_valid_slots() const;
+
+    u32 session() const { return m_stored.session; }
+
+private:
+    const Slot* slot_for(s32 target_temperature) const;
+
+    bool is_usable(const Slot&, bool trust_previous_sessions) const;
+
+    Slot& slot_to_replace(s32 target_temperature);
+
+    Stored m_stored;
+};
+}
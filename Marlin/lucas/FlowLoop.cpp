@@ -0,0 +1,34 @@
+#include "FlowLoop.h"
+#include <algorithm>
+
+namespace lucas {
+void FlowLoop::reset() {
+    m_integral = 0.f;
+    m_last_error = 0.f;
+    m_has_last_error = false;
+}
+
+u32 FlowLoop::update(f32 target_flow, f32 measured_flow, u32 feed_forward, f32 dt) {
+    if (dt <= 0.f)
+        return std::clamp(feed_forward, MIN_SIGNAL, MAX_SIGNAL);
+
+    const auto error = target_flow - measured_flow;
+    const auto derivative = m_has_last_error ? (error - m_last_error) / dt : 0.f;
+    m_last_error = error;
+    m_has_last_error = true;
+
+    const auto output = [&] {
+        return f32(feed_forward) + m_gains.kp * error + m_gains.ki * m_integral + m_gains.kd * derivative;
+    };
+
+    // anti-windup: while the output is pinned at one of its limits the error can't be corrected
+    // so the integral only keeps accumulating if that brings the output back into range
+    const auto unsaturated = output();
+    const auto pinned_high = unsaturated >= MAX_SIGNAL and error > 0.f;
+    const auto pinned_low = unsaturated <= MIN_SIGNAL and error < 0.f;
+    if (not pinned_high and not pinned_low)
+        m_integral = std::clamp(m_integral + error * dt, -MAX_INTEGRAL, MAX_INTEGRAL);
+
+    return u32(std::clamp(output(), f32(MIN_SIGNAL), f32(MAX_SIGNAL)));
+}
+}
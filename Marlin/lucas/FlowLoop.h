@@ -0,0 +1,46 @@
+#pragma once
+
+#include <lucas/types.h>
+
+namespace lucas {
+// a PI(D) around the flow of a pour, meant to run many times per second
+// the calibration table already gets the signal close to the right one, so it's used as a feed-forward and the loop only corrects what it gets wrong
+class FlowLoop {
+public:
+    struct Gains {
+        // in digital signal per g/s of error
+        f32 kp = 60.f;
+        // in digital signal per g of accumulated error
+        f32 ki = 150.f;
+        // in digital signal per g/s² of change in the error
+        f32 kd = 0.f;
+    };
+
+    // forgets everything about the previous pour
+    void reset();
+
+    // the signal that should be sent to the driver, `dt` being the time since the last update in seconds
+    u32 update(f32 target_flow, f32 measured_flow, u32 feed_forward, f32 dt);
+
+    const Gains& gains() const { return m_gains; }
+
+    void set_gains(const Gains& gains) {
+        m_gains = gains;
+        reset();
+    }
+
+    // the pump stops completely at 0, which the loop is never supposed to do in the middle of a pour
+    static constexpr u32 MIN_SIGNAL = 1;
+    static constexpr u32 MAX_SIGNAL = 4095;
+
+    // in g, the most error the integral can remember
+    static constexpr f32 MAX_INTEGRAL = 5.f;
+
+private:
+    Gains m_gains;
+
+    f32 m_integral = 0.f;
+    f32 m_last_error = 0.f;
+    bool m_has_last_error = false;
+};
+}
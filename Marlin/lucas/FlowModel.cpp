@@ -0,0 +1,85 @@
+#include "FlowModel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace lucas {
+// solves the normal equations of a polynomial with `Degree + 1` coefficients, using gaussian elimination with partial pivoting
+template<usize Degree>
+static std::optional<std::array<f32, 3>> least_squares(std::span<const FlowModel::Sample> samples) {
+    constexpr usize N = Degree + 1;
+    // doubles since the sums of the powers of the flow quickly lose precision in floats
+    std::array<std::array<f64, N + 1>, N> system = {};
+    for (const auto& sample : samples) {
+        std::array<f64, N> powers = {};
+        powers[0] = 1.;
+        for (usize i = 1; i < N; ++i)
+            powers[i] = powers[i - 1] * sample.flow;
+
+        for (usize row = 0; row < N; ++row) {
+            for (usize column = 0; column < N; ++column)
+                system[row][column] += powers[row] * powers[column];
+            system[row][N] += powers[row] * sample.digital_signal;
+        }
+    }
+
+    for (usize pivot = 0; pivot < N; ++pivot) {
+        usize best = pivot;
+        for (usize row = pivot + 1; row < N; ++row) {
+            if (std::abs(system[row][pivot]) > std::abs(system[best][pivot]))
+                best = row;
+        }
+
+        if (std::abs(system[best][pivot]) < 1e-9)
+            return std::nullopt;
+
+        std::swap(system[pivot], system[best]);
+        for (usize row = 0; row < N; ++row) {
+            if (row == pivot)
+                continue;
+
+            const auto factor = system[row][pivot] / system[pivot][pivot];
+            for (usize column = pivot; column <= N; ++column)
+                system[row][column] -= factor * system[pivot][column];
+        }
+    }
+
+    std::array<f32, 3> coefficients = {};
+    for (usize i = 0; i < N; ++i)
+        coefficients[i] = f32(system[i][N] / system[i][i]);
+    return coefficients;
+}
+
+template<usize Degree>
+static std::optional<FlowModel> fit_with_degree(std::span<const FlowModel::Sample> samples, f32 min_flow, f32 max_flow) {
+    constexpr usize N = Degree + 1;
+    if (samples.size() <= N)
+        return std::nullopt;
+
+    const auto coefficients = least_squares<Degree>(samples);
+    if (not coefficients)
+        return std::nullopt;
+
+    FlowModel model;
+    model.coefficients = *coefficients;
+    // the slope changes linearly, so it's enough to check both ends
+    if (model.slope_at(min_flow) <= 0.f or model.slope_at(max_flow) <= 0.f)
+        return std::nullopt;
+
+    f32 squared_residuals = 0.f;
+    for (const auto& sample : samples) {
+        const auto residual = f32(sample.digital_signal) - model.signal_for(sample.flow);
+        squared_residuals += residual * residual;
+        model.max_residual = std::max(model.max_residual, std::abs(residual));
+    }
+    model.residual_std = std::sqrt(squared_residuals / (samples.size() - N));
+    model.number_of_samples = samples.size();
+    return model;
+}
+
+std::optional<FlowModel> FlowModel::fit(std::span<const Sample> samples, f32 min_flow, f32 max_flow) {
+    if (auto model = fit_with_degree<2>(samples, min_flow, max_flow))
+        return model;
+
+    return fit_with_degree<1>(samples, min_flow, max_flow);
+}
+}
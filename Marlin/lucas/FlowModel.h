@@ -0,0 +1,37 @@
+#pragma once
+
+#include <lucas/types.h>
+#include <array>
+#include <optional>
+#include <span>
+
+namespace lucas {
+// the digital signal needed for each flow, as a smooth curve fitted by least squares to a handful of measured points
+// it's a second degree polynomial whenever that's monotone over the range of the table, and a line otherwise
+struct FlowModel {
+    struct Sample {
+        f32 flow = 0.f;
+        u32 digital_signal = 0;
+    };
+
+    // the model has to be increasing from `min_flow` to `max_flow`, if not even a line is then there's no model
+    static std::optional<FlowModel> fit(std::span<const Sample>, f32 min_flow, f32 max_flow);
+
+    f32 signal_for(f32 flow) const { return coefficients[0] + flow * (coefficients[1] + flow * coefficients[2]); }
+
+    // in digital signal per g/s
+    f32 slope_at(f32 flow) const { return coefficients[1] + 2.f * flow * coefficients[2]; }
+
+    // from the lowest to the highest degree
+    std::array<f32, 3> coefficients = {};
+
+    // how far the samples are from the model, in digital signal
+    f32 residual_std = 0.f;
+    f32 max_residual = 0.f;
+
+    usize number_of_samples = 0;
+
+    // at least one more than the number of coefficients, otherwise there's nothing to tell how good the fit is
+    static constexpr usize MIN_SAMPLES = 3;
+};
+}
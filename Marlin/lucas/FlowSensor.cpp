@@ -0,0 +1,139 @@
+#include "FlowSensor.h"
+#include <lucas/util/SpscRing.h>
+#include <cmath>
+
+namespace lucas {
+static HardwareTimer* s_timer = nullptr;
+static u32 s_channel = 0;
+
+// the counter only has 16 bits, the overflows are counted so the timestamps have 32 bits (a little over an hour at 1MHz)
+static volatile u32 s_overflows = 0;
+static volatile u32 s_overruns = 0;
+
+static util::SpscRing<u32, 64> s_timestamps;
+
+static void on_overflow() {
+    ++s_overflows;
+}
+
+static void on_capture() {
+    const u32 capture = s_timer->getCaptureCompare(s_channel, TICK_COMPARE_FORMAT);
+    u32 overflows = s_overflows;
+    // the captures are handled before the overflow when both happen at once, so a capture from right after it would look like it's from the past
+    if (__HAL_TIM_GET_FLAG(s_timer->getHandle(), TIM_FLAG_UPDATE) and capture < 0x8000)
+        ++overflows;
+
+    if (not s_timestamps.push((overflows << 16) | capture))
+        ++s_overruns;
+
+    ++FlowSensor::s_pulse_counter;
+}
+
+void FlowSensor::setup(pin_t pin) {
+    if (s_timer)
+        return;
+
+    const auto pin_name = digitalPinToPinName(pin);
+    s_channel = STM_PIN_CHANNEL(pinmap_function(pin_name, PinMap_TIM));
+    s_timer = new HardwareTimer(static_cast<TIM_TypeDef*>(pinmap_peripheral(pin_name, PinMap_TIM)));
+
+    s_timer->setMode(s_channel, TIMER_INPUT_CAPTURE_RISING, pin);
+    s_timer->setPrescaleFactor(s_timer->getTimerClkFreq() / TIMER_FREQUENCY);
+    s_timer->setOverflow(0x10000, TICK_FORMAT);
+    s_timer->attachInterrupt(s_channel, on_capture);
+    s_timer->attachInterrupt(on_overflow);
+    s_timer->resume();
+
+    LOG_IF(LogCalibration, "sensor de fluxo configurado - [canal = ", s_channel, "]");
+}
+
+void FlowSensor::tick() {
+    while (const auto timestamp = s_timestamps.pop()) {
+        m_newest = (m_newest + 1) % HISTORY_SIZE;
+        m_history[m_newest] = *timestamp;
+        m_history_size = std::min(m_history_size + 1, HISTORY_SIZE);
+    }
+}
+
+f32 FlowSensor::instantaneous_frequency() {
+    tick();
+    if (m_history_size < 2)
+        return 0.f;
+
+    const auto since_last_pulse = now() - timestamp(0);
+    if (since_last_pulse >= FLOW_TIMEOUT_US)
+        return 0.f;
+
+    const auto period = std::max(timestamp(0) - timestamp(1), since_last_pulse);
+    return period ? f32(TIMER_FREQUENCY) / period : 0.f;
+}
+
+f32 FlowSensor::mean_frequency(u32 window_us) {
+    const auto count = timestamps_within(window_us);
+    // a single pulse doesn't make a period, and neither does a window that's too short for the flow
+    if (count < 2)
+        return instantaneous_frequency();
+
+    const auto span = timestamp(0) - timestamp(count - 1);
+    return span ? f32(TIMER_FREQUENCY) * (count - 1) / span : 0.f;
+}
+
+f32 FlowSensor::jitter(u32 window_us) {
+    const auto count = timestamps_within(window_us);
+    if (count < 3)
+        return 0.f;
+
+    const auto periods = count - 1;
+    const auto mean = f32(timestamp(0) - timestamp(count - 1)) / periods;
+    f32 variance = 0.f;
+    for (usize i = 0; i < periods; ++i) {
+        const auto deviation = f32(timestamp(i) - timestamp(i + 1)) - mean;
+        variance += deviation * deviation;
+    }
+    return std::sqrt(variance / periods);
+}
+
+std::optional<u32> FlowSensor::first_pulse_since(u32 since_us) {
+    tick();
+    for (usize i = m_history_size; i > 0; --i) {
+        // compared as a difference so it keeps working when the timestamps wrap around
+        if (s32(timestamp(i - 1) - since_us) >= 0)
+            return timestamp(i - 1);
+    }
+    return std::nullopt;
+}
+
+u32 FlowSensor::overruns() const {
+    return s_overruns;
+}
+
+u32 FlowSensor::now() {
+    if (not s_timer)
+        return 0;
+
+    // the counter and the overflows can't be read at once, so it's read again whenever an overflow is handled in between
+    u32 overflows = 0;
+    u32 count = 0;
+    bool pending = false;
+    do {
+        overflows = s_overflows;
+        count = s_timer->getCount(TICK_FORMAT);
+        pending = __HAL_TIM_GET_FLAG(s_timer->getHandle(), TIM_FLAG_UPDATE);
+    } while (overflows != s_overflows);
+
+    // just like in `on_capture`, the counter may have wrapped before the interrupt had the chance to run
+    if (pending and count < 0x8000)
+        ++overflows;
+
+    return (overflows << 16) | count;
+}
+
+usize FlowSensor::timestamps_within(u32 window_us) {
+    tick();
+    const auto current = now();
+    usize count = 0;
+    while (count < m_history_size and current - timestamp(count) <= window_us)
+        ++count;
+    return count;
+}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <lucas/lucas.h>
+#include <lucas/util/Singleton.h>
+
+namespace lucas {
+// the flow sensor, read through the input capture of a hardware timer so that every pulse gets the exact time in which it happened
+// the interrupt only timestamps the pulses, the main loop consumes them into a short history from which the flow is estimated
+class FlowSensor : public util::Singleton<FlowSensor> {
+public:
+    // the timer and its channel are picked from the pin itself
+    void setup(pin_t pin);
+
+    // moves the pulses timestamped since the last call into the history
+    void tick();
+
+    // in pulses/s, from the period between the last two pulses
+    // a pulse that's taking longer than that already lowers it, so a flow that stops is noticed before the next pulse
+    f32 instantaneous_frequency();
+
+    // in pulses/s, over the pulses of the last `window_us`
+    f32 mean_frequency(u32 window_us);
+
+    // the standard deviation of the periods between the pulses of the last `window_us`, in us
+    f32 jitter(u32 window_us);
+
+    // the timestamp of the oldest pulse still in the history that came after `since_us`
+    std::optional<u32> first_pulse_since(u32 since_us);
+
+    // pulses that couldn't be timestamped because the main loop took too long to consume them, they're still counted
+    u32 overruns() const;
+
+    // every pulse so far, `Spout::s_pulse_counter` is the very same counter
+    static volatile inline u32 s_pulse_counter = 0;
+
+    static constexpr u32 TIMER_FREQUENCY = 1'000'000;
+
+    static constexpr usize HISTORY_SIZE = 32;
+
+    // without a pulse for this long the flow is considered stopped
+    static constexpr u32 FLOW_TIMEOUT_US = 500'000;
+
+    // the current time in the same timebase as the timestamps
+    static u32 now();
+
+private:
+    friend class util::Singleton<FlowSensor>;
+
+    FlowSensor() = default;
+
+    // `i` being 0 for the newest
+    u32 timestamp(usize i) const { return m_history[(m_newest + HISTORY_SIZE - i) % HISTORY_SIZE]; }
+
+    // how many of the newest timestamps are within the window
+    usize timestamps_within(u32 window_us);
+
+    std::array<u32, HISTORY_SIZE> m_history = {};
+    usize m_newest = 0;
+    usize m_history_size = 0;
+};
+}
@@ -3,11 +3,23 @@
 #include <lucas/cmd/cmd.h>
 #include <lucas/Station.h>
 #include <src/module/planner.h>
+#include <limits>
 
 namespace lucas {
 void MotionController::setup() {
-    change_step_ratio(1.f);
+    planner.settings.axis_steps_per_mm[X_AXIS] = STEPS_PER_MM_X;
+    planner.settings.axis_steps_per_mm[Y_AXIS] = STEPS_PER_MM_Y;
+    planner.refresh_positioning();
     change_max_acceleration(5000);
+
+    m_travel_times_storage_handle = storage::register_handle_for_entry("travel", sizeof(m_travel_times));
+    if (auto entry = storage::fetch_entry(m_travel_times_storage_handle))
+        entry->read_binary_into(m_travel_times);
+}
+
+void MotionController::tick() {
+    if (m_travel and not planner.busy())
+        complete_travel();
 }
 
 void MotionController::travel_to_station(const Station& station, float offset) {
@@ -15,39 +27,150 @@ void MotionController::travel_to_station(const Station& station, float offset) {
 }
 
 void MotionController::travel_to_station(usize index, float offset) {
-    if (m_current_location == index)
+    begin_travel_to_station(index, nullptr, offset);
+    finish_travel();
+}
+
+void MotionController::travel_to_sewer() {
+    begin_travel_to_sewer();
+    finish_travel();
+}
+
+void MotionController::begin_travel_to_station(usize index, ArrivalCallback on_arrival, float offset) {
+    if (heading_to(index))
         return;
 
     LOG_IF(LogTravel, "viajando - [estacao = ", index, " | offset = ", offset, "]");
 
-    const auto beginning = millis();
-    const auto gcode = util::ff("G0 F25000 Y60 X%s", Station::absolute_position(index) + offset);
-    cmd::execute_multiple("G90",
-                          gcode,
-                          "G91");
-    finish_movements();
-    m_current_location = index;
-
-    LOG_IF(LogTravel, "chegou - [tempo = ", millis() - beginning, "ms]");
+    begin_travel_to_location(index, offset, on_arrival);
 }
 
-void MotionController::travel_to_sewer() {
-    if (m_current_location == SEWER_LOCATION)
+void MotionController::begin_travel_to_sewer(ArrivalCallback on_arrival) {
+    if (heading_to(SEWER_LOCATION))
         return;
 
     LOG_IF(LogTravel, "viajando para o esgoto");
 
-    const auto beginning = millis();
-    cmd::execute_multiple("G90",
-                          "G0 F5000 Y60 X0",
-                          "G91");
+    begin_travel_to_location(SEWER_LOCATION, 0.f, on_arrival);
+}
+
+void MotionController::finish_travel() {
+    if (not m_travel)
+        return;
+
     finish_movements();
-    m_current_location = SEWER_LOCATION;
+    // `tick` may have already completed it while idling
+    if (m_travel)
+        complete_travel();
+}
+
+std::optional<millis_t> MotionController::expected_arrival() const {
+    if (not m_travel)
+        return std::nullopt;
+
+    // `m_current_location` is still where the travel started from
+    return m_travel->beginning + travel_time(m_current_location, m_travel->location);
+}
+
+void MotionController::travel_to_location(usize location, float offset) {
+    begin_travel_to_location(location, offset, nullptr);
+    finish_travel();
+}
+
+void MotionController::begin_travel_to_location(usize location, float offset, ArrivalCallback on_arrival) {
+    finish_travel();
+
+    m_travel = Travel{ location, offset, millis(), on_arrival };
+    if (location == SEWER_LOCATION) {
+        cmd::execute_multiple("G90",
+                              "G0 F5000 Y60 X0",
+                              "G91");
+    } else {
+        const auto gcode = util::ff("G0 F25000 Y60 X%s", Station::absolute_position(location) + offset);
+        cmd::execute_multiple("G90",
+                              gcode,
+                              "G91");
+    }
+}
+
+void MotionController::complete_travel() {
+    // cleared before the callback, which is free to start another travel
+    const auto travel = *m_travel;
+    m_travel.reset();
+
+    const auto time = millis() - travel.beginning;
+    // travels with an offset don't end at the location itself, so they don't tell us anything
+    if (m_current_location != INVALID_LOCATION and travel.offset == 0.f)
+        register_travel_time(m_current_location, travel.location, time);
+    m_current_location = travel.location;
+
+    LOG_IF(LogTravel, "chegou - [tempo = ", time, "ms]");
+
+    if (travel.on_arrival)
+        travel.on_arrival(travel.location);
+}
+
+void MotionController::calibrate_travel_times() {
+    const auto number_of_locations = Station::number_of_stations() + 1;
+    const auto location = [](usize i) {
+        return i == 0 ? SEWER_LOCATION : i - 1;
+    };
+
+    LOG_IF(LogCalibration, "medindo tempos de viagem");
+
+    // the sewer is travelled to slower than the stations, so both ways of every pair are measured
+    for (usize i = 0; i < number_of_locations; ++i) {
+        for (usize j = 0; j < number_of_locations; ++j) {
+            if (i == j)
+                continue;
+
+            const auto from = location(i);
+            const auto to = location(j);
+            if (m_travel_times[from][to])
+                continue;
+
+            travel_to_location(from, 0.f);
+            travel_to_location(to, 0.f);
+        }
+    }
+
+    save_travel_times();
+}
+
+millis_t MotionController::travel_time(usize from, usize to) const {
+    if (from == to)
+        return 0;
+
+    if (from >= NUMBER_OF_LOCATIONS or to >= NUMBER_OF_LOCATIONS or m_travel_times[from][to] == 0)
+        return util::TRAVEL_MARGIN;
+
+    return m_travel_times[from][to] + TRAVEL_TIME_SAFETY_MARGIN;
+}
+
+void MotionController::register_travel_time(usize from, usize to, millis_t time) {
+    if (from == to or from >= NUMBER_OF_LOCATIONS or to >= NUMBER_OF_LOCATIONS)
+        return;
+
+    const auto sample = static_cast<s32>(std::min<millis_t>(time, std::numeric_limits<u16>::max()));
+    const auto previous = static_cast<s32>(m_travel_times[from][to]);
+    // the first sample is taken as is, the following ones are smoothed out
+    const auto updated = previous == 0 ? sample : previous + ((sample - previous) >> TRAVEL_TIME_SMOOTHING_SHIFT);
+    m_travel_times[from][to] = std::max<u16>(updated, 1);
+
+    LOG_IF(LogTravel, "tempo de viagem atualizado - [de = ", from, " | para = ", to, " | tempo = ", m_travel_times[from][to], "ms]");
+
+    if (++m_unsaved_travel_time_samples >= TRAVEL_TIME_SAMPLES_PER_SAVE)
+        save_travel_times();
+}
 
-    LOG_IF(LogTravel, "chegou - [tempo = ", millis() - beginning, "ms]");
+void MotionController::save_travel_times() {
+    m_unsaved_travel_time_samples = 0;
+    auto entry = storage::create_entry(m_travel_times_storage_handle);
+    entry.write_binary(m_travel_times);
 }
 
 void MotionController::home() {
+    finish_travel();
     m_current_location = INVALID_LOCATION;
     cmd::execute("G28 XY");
     finish_movements();
@@ -57,22 +180,59 @@ void MotionController::finish_movements() const {
     util::idle_while(&Planner::busy, core::Filter::RecipeQueue);
 }
 
-float MotionController::step_ratio_x() const {
-    return planner.settings.axis_steps_per_mm[X_AXIS] / DEFAULT_STEPS_PER_MM_X;
+void MotionController::move_by(f32 x, f32 y, f32 feedrate_mm_s) const {
+    current_position.x += x;
+    current_position.y += y;
+    planner.buffer_line(current_position, feedrate_mm_s);
 }
 
-float MotionController::step_ratio_y() const {
-    return planner.settings.axis_steps_per_mm[Y_AXIS] / DEFAULT_STEPS_PER_MM_Y;
+millis_t MotionController::move_time(f32 length, f32 feedrate_mm_s) const {
+    const auto acceleration = planner.settings.travel_acceleration;
+    const auto feedrate = std::min({ feedrate_mm_s, planner.settings.max_feedrate_mm_s[X_AXIS], planner.settings.max_feedrate_mm_s[Y_AXIS] });
+    length = std::abs(length);
+    if (length == 0.f or feedrate <= 0.f or acceleration <= 0.f)
+        return 0;
+
+    // too short to ever reach the feedrate, the profile is a triangle
+    if (length < feedrate * feedrate / acceleration)
+        return millis_t(2000.f * std::sqrt(length / acceleration));
+
+    return millis_t(1000.f * (length / feedrate + feedrate / acceleration));
 }
 
-void MotionController::change_step_ratio(f32 ratio_x, f32 ratio_y) const {
-    planner.settings.axis_steps_per_mm[X_AXIS] = DEFAULT_STEPS_PER_MM_X * ratio_x;
-    planner.settings.axis_steps_per_mm[Y_AXIS] = DEFAULT_STEPS_PER_MM_Y * ratio_y;
-    planner.refresh_positioning();
+f32 MotionController::feedrate_for_timed_path(f32 length, millis_t duration) const {
+    const auto acceleration = planner.settings.travel_acceleration;
+    const auto max_feedrate = std::min(planner.settings.max_feedrate_mm_s[X_AXIS], planner.settings.max_feedrate_mm_s[Y_AXIS]);
+    const auto time = duration / 1000.f;
+
+    // accelerating to `v`, cruising and decelerating back to 0 covers `L = v * T - v^2 / a`
+    // so the speed is the smaller root of `v^2 - a * T * v + a * L = 0`
+    const auto discriminant = acceleration * acceleration * time * time - 4.f * acceleration * length;
+    f32 feedrate = 0.f;
+    if (discriminant < 0.f) {
+        // not even a triangular profile covers the path in time, so the fastest one is used
+        feedrate = acceleration * time / 2.f;
+        LOG_IF(LogTravel, "caminho nao cabe no tempo - [comprimento = ", length, "mm | duracao = ", duration, "ms]");
+    } else {
+        feedrate = (acceleration * time - std::sqrt(discriminant)) / 2.f;
+    }
+
+    return std::min(feedrate * m_timed_path_correction, max_feedrate);
 }
 
-void MotionController::change_step_ratio(float ratio) const {
-    change_step_ratio(ratio, ratio);
+void MotionController::register_timed_path_duration(millis_t expected, millis_t actual) {
+    if (expected == 0 or actual == 0)
+        return;
+
+    constexpr auto MIN_CORRECTION = 0.8f;
+    constexpr auto MAX_CORRECTION = 1.5f;
+    constexpr auto SMOOTHING = 0.25f;
+
+    const auto error = f32(actual) / f32(expected);
+    const auto corrected = m_timed_path_correction * error;
+    m_timed_path_correction = std::clamp(std::lerp(m_timed_path_correction, corrected, SMOOTHING), MIN_CORRECTION, MAX_CORRECTION);
+
+    LOG_IF(LogTravel, "caminho cronometrado - [esperado = ", expected, "ms | real = ", actual, "ms | correcao = ", m_timed_path_correction, "]");
 }
 
 void MotionController::change_max_acceleration(f32 accel) const {
@@ -2,30 +2,111 @@
 
 #include <lucas/util/Singleton.h>
 #include <lucas/Station.h>
+#include <lucas/Trajectory.h>
+#include <lucas/Spout.h>
+#include <lucas/storage/storage.h>
+#include <lucas/util/ScopedGuard.h>
+#include <src/module/motion.h>
+#include <src/module/planner.h>
 #include <cstddef>
+#include <optional>
+#include <span>
 
 namespace lucas {
 class MotionController : public util::Singleton<MotionController> {
 public:
     void setup();
 
+    void tick();
+
     void travel_to_station(const Station&, float offset = 0.f);
 
     void travel_to_station(usize, float offset = 0.f);
 
-    void finish_movements() const;
+    // called from `tick` once the spout gets to where it was sent
+    using ArrivalCallback = void (*)(usize location);
 
-    void travel_to_sewer();
+    // sends the spout to the station without waiting for it to get there, nothing happens if it's already there or on its way
+    // only one travel is tracked at a time, so a travel to somewhere else is finished before the new one starts
+    void begin_travel_to_station(usize, ArrivalCallback on_arrival = nullptr, float offset = 0.f);
 
-    void home();
+    void begin_travel_to_sewer(ArrivalCallback on_arrival = nullptr);
+
+    // waits for the travel that's going on, if there's any
+    void finish_travel();
+
+    bool travelling() const { return m_travel.has_value(); }
+
+    // the spout is either at the location or on its way there
+    bool heading_to(usize location) const { return destination() == location; }
+
+    // the tick in which the travel that's going on should end, nothing if there's none
+    std::optional<millis_t> expected_arrival() const;
 
-    float step_ratio_x() const;
+    // whether the spout is standing still at the location, and not just on its way there
+    bool is_at(usize location) const { return not travelling() and m_current_location == location; }
 
-    float step_ratio_y() const;
+    void finish_movements() const;
+
+    // moves relative to the current position straight through the planner, without waiting for the movement to finish
+    void move_by(f32 x, f32 y, f32 feedrate_mm_s) const;
+
+    // how long a straight move of `length` mm takes, accelerating from and decelerating back to a stop
+    millis_t move_time(f32 length, f32 feedrate_mm_s) const;
+
+    void travel_to_sewer();
 
-    void change_step_ratio(f32 ratio) const;
+    void home();
 
-    void change_step_ratio(f32 ratio_x, f32 ratio_y) const;
+    // follows the spirals, one after the other, so that the whole movement takes `duration` (or at the pattern speed if it's 0)
+    // the spirals share the same center, and the spout must already be at the beginning of the first one
+    // the speed is computed from the planner's own limits, so its configuration is never touched
+    // returns false if `should_stop` interrupted the movement, `current_position` is where the spout stopped either way
+    bool follow_timed_path(std::span<const Spiral> spirals, millis_t duration, util::Fn<bool> auto&& should_stop) {
+        if (spirals.empty())
+            return true;
+
+        const auto& first = spirals.front();
+        auto center = current_position;
+        center.x -= first.x_at(0.f);
+        center.y -= first.y_at(0.f) * ANGLE_FIX;
+
+        auto feedrate = PATTERN_FEEDRATE;
+        f32 length = 0.f;
+        if (duration) {
+            for (const auto& spiral : spirals)
+                length += Trajectory{ center, feedrate, ANGLE_FIX }.length_of(spiral);
+            feedrate = feedrate_for_timed_path(length, duration);
+        }
+
+        Trajectory trajectory{ center, feedrate, ANGLE_FIX };
+        trajectory.start_at(first.x_at(0.f), first.y_at(0.f));
+        if (duration and length and CFG(FlowSyncPour))
+            trajectory.sync_flow(length, length / (duration / 1000.f));
+
+        // the widest patterns go slightly past the soft endstops on the y axis
+        soft_endstop._enabled = false;
+        util::ScopedGuard guard = [] {
+            soft_endstop._enabled = true;
+            // every move is done by now, so the pour goes back to its own flow
+            planner.next_flow_tag = Spout::NO_FLOW_TAG;
+            Spout::s_block_flow_tag = Spout::NO_FLOW_TAG;
+        };
+
+        const auto beginning = millis();
+        for (const auto& spiral : spirals) {
+            if (not trajectory.follow(spiral, should_stop)) {
+                finish_movements();
+                return false;
+            }
+        }
+        finish_movements();
+
+        if (duration)
+            register_timed_path_duration(duration, millis() - beginning);
+
+        return true;
+    }
 
     void change_max_acceleration(f32 accel) const;
 
@@ -33,17 +114,80 @@ public:
 
     void toggle_motors_stress_test();
 
-    static inline float MS_PER_MM = 12.41f;
-    static constexpr float DEFAULT_STEPS_PER_MM_X = 22.0f;
-    static constexpr float DEFAULT_STEPS_PER_MM_Y = 8.5f;
+    // measures every travel between two locations, in both ways, that hasn't been measured yet
+    void calibrate_travel_times();
+
+    // the time it takes for the spout to travel between two stations, falling back to `util::TRAVEL_MARGIN` if it's unknown
+    // `SEWER` can be used for either of them
+    millis_t travel_time(usize from, usize to) const;
+
+    // a spout that's on its way somewhere is treated as if it was already there
+    millis_t travel_time_to_station(usize index) const { return travel_time(destination(), index); }
+
+    static constexpr auto SEWER = Station::MAXIMUM_NUMBER_OF_STATIONS;
+
+    // the speeds used by the pour patterns without a duration, in mm/s
+    static constexpr f32 PATTERN_FEEDRATE = 5000.f / 60.f;
+    static constexpr f32 REPOSITION_FEEDRATE = 10000.f / 60.f;
+    static constexpr float STEPS_PER_MM_X = 22.0f;
+    static constexpr float STEPS_PER_MM_Y = 8.5f;
     static constexpr float ANGLE_FIX = 1.2f;
 
 private:
     static constexpr auto INVALID_LOCATION = static_cast<usize>(-1);
-    static constexpr auto SEWER_LOCATION = Station::MAXIMUM_NUMBER_OF_STATIONS + 1;
+    static constexpr auto SEWER_LOCATION = SEWER;
+
+    static constexpr usize NUMBER_OF_LOCATIONS = Station::MAXIMUM_NUMBER_OF_STATIONS + 1;
+
+    // how much a single travel changes the known time between two locations, as 1 / 2^N
+    static constexpr usize TRAVEL_TIME_SMOOTHING_SHIFT = 2;
+
+    // the travel times are only written to the sd card after this many new samples
+    static constexpr usize TRAVEL_TIME_SAMPLES_PER_SAVE = 16;
+
+    // extra time added on top of every known travel time, covering the small variations between travels
+    static constexpr millis_t TRAVEL_TIME_SAFETY_MARGIN = 100;
+
+    void travel_to_location(usize location, float offset);
+
+    void begin_travel_to_location(usize location, float offset, ArrivalCallback on_arrival);
+
+    void complete_travel();
+
+    usize destination() const { return m_travel ? m_travel->location : m_current_location; }
+
+    void register_travel_time(usize from, usize to, millis_t time);
+
+    // the cruise speed of a trapezoidal profile that covers `length` in `duration`, accelerating and decelerating with the planner's acceleration
+    f32 feedrate_for_timed_path(f32 length, millis_t duration) const;
+
+    // the planner slows down on tight curves, which the trapezoid doesn't account for, so the real durations are used to correct the speed
+    void register_timed_path_duration(millis_t expected, millis_t actual);
+
+    void save_travel_times();
 
     usize m_current_location = INVALID_LOCATION;
 
+    struct Travel {
+        usize location = INVALID_LOCATION;
+        float offset = 0.f;
+        millis_t beginning = 0;
+        ArrivalCallback on_arrival = nullptr;
+    };
+
+    // the travel that's going on, `m_current_location` only changes once it's over
+    std::optional<Travel> m_travel;
+
+    // multiplies the speed of every timed path, learned from how long they actually take
+    f32 m_timed_path_correction = 1.f;
+
+    // the time, in ms, it takes to travel from each location (row) to each other (column), 0 meaning unknown
+    // the two ways aren't the same, since the travels to the sewer are slower
+    using TravelTimes = std::array<std::array<u16, NUMBER_OF_LOCATIONS>, NUMBER_OF_LOCATIONS>;
+    TravelTimes m_travel_times = {};
+    usize m_unsaved_travel_time_samples = 0;
+    storage::Handle m_travel_times_storage_handle;
+
     bool m_motor_stress_test = false;
 };
 }
@@ -0,0 +1,110 @@
+#include "PourLog.h"
+#include <lucas/lucas.h>
+#include <lucas/info/info.h>
+#include <cmath>
+
+namespace lucas {
+void PourLog::setup() {
+    m_storage_handle = storage::register_handle_for_entry("pours", sizeof(Stored));
+    if (auto entry = storage::fetch_entry(m_storage_handle)) {
+        Stored stored;
+        entry->read_binary_into(stored);
+        if (stored.version == STORAGE_VERSION and stored.oldest < CAPACITY and stored.number_of_records <= CAPACITY)
+            m_stored = stored;
+    }
+}
+
+bool PourLog::add(Record record) {
+    record.sequence = ++m_stored.sequence;
+
+    const auto mismatched = is_mismatched(record);
+    if (mismatched)
+        record.flags |= Mismatched;
+
+    if (m_stored.number_of_records < CAPACITY) {
+        m_stored.records[(m_stored.oldest + m_stored.number_of_records) % CAPACITY] = record;
+        ++m_stored.number_of_records;
+    } else {
+        m_stored.records[m_stored.oldest] = record;
+        m_stored.oldest = (m_stored.oldest + 1) % CAPACITY;
+    }
+
+    if (CFG(SavePourRecords) and ++m_unsaved_records >= RECORDS_PER_SAVE)
+        save();
+
+    // interrupted pours and the ones without a volume neither count towards the error nor break the streak
+    if (record.desired_volume == 0.f or (record.flags & Interrupted))
+        return false;
+
+    m_consecutive_mismatches = mismatched ? m_consecutive_mismatches + 1 : 0;
+    if (mismatched)
+        LOG_ERR("volume do despejo nao bate - [desejado = ", record.desired_volume, " | medido = ", record.measured_volume, " | seguidos = ", m_consecutive_mismatches, "]");
+
+    if (m_consecutive_mismatches < m_stored.thresholds.consecutive)
+        return false;
+
+    m_consecutive_mismatches = 0;
+    // the records that led to the error are worth keeping, whatever the option says
+    save();
+    return true;
+}
+
+void PourLog::send_records(usize count) const {
+    // the buffer of a json document doesn't hold every record at once, so they go out in a few messages
+    constexpr usize RECORDS_PER_MESSAGE = 6;
+
+    const auto total = m_stored.number_of_records;
+    const auto first = count and count < total ? total - count : 0;
+    usize begin = first;
+    do {
+        info::send(
+            info::Event::Other,
+            [&](JsonObject o) {
+                auto array = o.createNestedArray("pours");
+                for (usize i = begin; i < std::min(begin + RECORDS_PER_MESSAGE, total); ++i) {
+                    const auto& r = record(i);
+                    auto obj = array.createNestedObject();
+                    obj["seq"] = r.sequence;
+                    obj["endedAt"] = r.ended_at;
+                    obj["duration"] = r.duration;
+                    obj["pulses"] = r.pulses;
+                    obj["desired"] = r.desired_volume;
+                    obj["measured"] = r.measured_volume;
+                    obj["minSignal"] = r.min_signal;
+                    obj["maxSignal"] = r.max_signal;
+                    obj["meanSignal"] = r.mean_signal;
+                    if (r.station != NO_STATION) {
+                        obj["station"] = r.station;
+                        obj["recipeId"] = r.recipe_id;
+                    }
+                    obj["flags"] = r.flags;
+                }
+            });
+        begin += RECORDS_PER_MESSAGE;
+    } while (begin < total);
+}
+
+void PourLog::set_thresholds(const Thresholds& thresholds) {
+    m_stored.thresholds = thresholds;
+    m_consecutive_mismatches = 0;
+    save();
+}
+
+bool PourLog::is_mismatched(const Record& record) const {
+    if (record.desired_volume == 0.f)
+        return false;
+
+    const auto error = std::abs(record.measured_volume - record.desired_volume);
+    return error > m_stored.thresholds.absolute and error > m_stored.thresholds.relative * record.desired_volume;
+}
+
+const PourLog::Record& PourLog::record(usize i) const {
+    return m_stored.records[(m_stored.oldest + i) % CAPACITY];
+}
+
+void PourLog::save() {
+    m_unsaved_records = 0;
+    auto entry = storage::fetch_or_create_entry(m_storage_handle);
+    entry.write_binary(m_stored);
+}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <lucas/storage/storage.h>
+#include <lucas/util/Singleton.h>
+#include <lucas/types.h>
+#include <ArduinoJson.h>
+#include <array>
+
+namespace lucas {
+// a compact record of every pour, kept in a ring in RAM that always holds the newest ones
+// nothing is sent on its own, the host asks for the records when it wants them, and they're only written to the sd card if `SavePourRecords` is active
+// it's also what notices the pours that keep missing their volume, like when the hose clogs or the sensor drifts
+class PourLog : public util::Singleton<PourLog> {
+public:
+    struct Record {
+        u32 sequence = 0;
+        // in ms since the machine was turned on
+        u32 ended_at = 0;
+        u32 duration = 0;
+        u32 pulses = 0;
+
+        // in ml, the desired one is 0 for pours made with a fixed digital signal
+        f32 desired_volume = 0.f;
+        f32 measured_volume = 0.f;
+
+        // the signal sent to the driver during the pour, the mean weighted by how long each one was sent
+        u16 min_signal = 0;
+        u16 max_signal = 0;
+        u16 mean_signal = 0;
+
+        u8 station = NO_STATION;
+        // see `Flags`
+        u8 flags = 0;
+
+        u64 recipe_id = 0;
+    };
+
+    static constexpr u8 NO_STATION = 0xFF;
+
+    enum Flags : u8 {
+        ClosedLoop = 1 << 0,
+        // the pour was interrupted before its duration, so its volume says nothing
+        Interrupted = 1 << 1,
+        Mismatched = 1 << 2,
+    };
+
+    struct Thresholds {
+        // a pour is mismatched when it's off by more than both of these
+        f32 relative = 0.2f;
+        f32 absolute = 8.f;
+        // and the error is only raised after this many mismatched pours in a row
+        u8 consecutive = 3;
+    };
+
+    void setup();
+
+    // returns true when the pour was the last straw and the mismatch error should be raised
+    bool add(Record);
+
+    // the newest `count` records, or all of them if it's 0, from the oldest to the newest
+    void send_records(usize count) const;
+
+    const Thresholds& thresholds() const { return m_stored.thresholds; }
+
+    void set_thresholds(const Thresholds&);
+
+    static constexpr usize CAPACITY = 32;
+
+    // the records are only written once this many new ones accumulate, since a write costs more than a pour is worth
+    static constexpr usize RECORDS_PER_SAVE = 8;
+
+    struct Stored {
+        u16 version = 0;
+        u32 sequence = 0;
+        Thresholds thresholds = {};
+        // the newest record is at `(oldest + number_of_records - 1) % CAPACITY`
+        usize oldest = 0;
+        usize number_of_records = 0;
+        std::array<Record, CAPACITY> records = {};
+    };
+
+    static constexpr u16 STORAGE_VERSION = 1;
+
+private:
+    friend class util::Singleton<PourLog>;
+
+    PourLog() = default;
+
+    bool is_mismatched(const Record&) const;
+
+    // `i` being 0 for the oldest
+    const Record& record(usize i) const;
+
+    void save();
+
+    Stored m_stored = { .version = STORAGE_VERSION };
+
+    usize m_consecutive_mismatches = 0;
+
+    usize m_unsaved_records = 0;
+
+    storage::Handle m_storage_handle;
+};
+}
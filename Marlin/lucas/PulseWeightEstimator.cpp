@@ -0,0 +1,107 @@
+#include "PulseWeightEstimator.h"
+#include <algorithm>
+#include <cmath>
+
+namespace lucas {
+// how much each weight is expected to be off before anything is learned, as variances
+// a pulse is around 0.5ml and the hand tuned constants are rarely off by more than 0.03ml
+static constexpr std::array<f32, 3> INITIAL_VARIANCES = { 0.03f * 0.03f, 0.005f * 0.005f, 0.001f * 0.001f };
+
+// the variance of a single observation, the volumes are measured to around 1%
+static constexpr f32 MEASUREMENT_VARIANCE = 0.005f * 0.005f;
+
+// older observations fade out slowly, so the estimator keeps up with a sensor that wears
+static constexpr f32 FORGETTING_FACTOR = 0.99f;
+
+// observations further than this many standard deviations from the prediction are considered mistakes
+static constexpr f32 MAX_DEVIATIONS = 4.f;
+
+void PulseWeightEstimator::reset(f32 weight_at_reference_flow, f32 weight_per_flow) {
+    m_stored = {};
+    m_stored.version = STORAGE_VERSION;
+    m_stored.weights = { weight_at_reference_flow, weight_per_flow, 0.f };
+    for (usize i = 0; i < INITIAL_VARIANCES.size(); ++i)
+        m_stored.covariance[i][i] = INITIAL_VARIANCES[i];
+}
+
+bool PulseWeightEstimator::update(const Observation& observation) {
+    if (observation.pulses < MIN_PULSES or observation.volume <= 0.f)
+        return false;
+
+    const auto weight = observation.volume / observation.pulses;
+    if (weight < MIN_WEIGHT or weight > MAX_WEIGHT)
+        return false;
+
+    const auto x = regressors(observation.flow, observation.temperature);
+    auto& theta = m_stored.weights;
+    auto& p = m_stored.covariance;
+
+    Vector px = {};
+    for (usize i = 0; i < 3; ++i)
+        for (usize j = 0; j < 3; ++j)
+            px[i] += p[i][j] * x[j];
+
+    f32 variance = MEASUREMENT_VARIANCE;
+    f32 predicted = 0.f;
+    for (usize i = 0; i < 3; ++i) {
+        variance += x[i] * px[i];
+        predicted += x[i] * theta[i];
+    }
+
+    const auto error = weight - predicted;
+    if (std::abs(error) > MAX_DEVIATIONS * std::sqrt(variance))
+        return false;
+
+    Vector gain = {};
+    for (usize i = 0; i < 3; ++i) {
+        gain[i] = px[i] / variance;
+        theta[i] += gain[i] * error;
+    }
+
+    // the covariance only grows back while it's below where it started, otherwise long stretches at the same flow would blow it up
+    f32 trace = 0.f;
+    for (usize i = 0; i < 3; ++i) {
+        for (usize j = 0; j < 3; ++j)
+            p[i][j] -= gain[i] * px[j];
+        trace += p[i][i];
+    }
+
+    f32 initial_trace = 0.f;
+    for (const auto v : INITIAL_VARIANCES)
+        initial_trace += v;
+
+    if (trace / FORGETTING_FACTOR < initial_trace) {
+        for (auto& row : p)
+            for (auto& v : row)
+                v /= FORGETTING_FACTOR;
+    }
+
+    ++m_stored.observations;
+    return true;
+}
+
+f32 PulseWeightEstimator::weight_for(f32 flow, f32 temperature) const {
+    const auto x = regressors(flow, temperature);
+    f32 weight = 0.f;
+    for (usize i = 0; i < 3; ++i)
+        weight += x[i] * m_stored.weights[i];
+    return std::clamp(weight, MIN_WEIGHT, MAX_WEIGHT);
+}
+
+bool PulseWeightEstimator::load(const Stored& stored) {
+    if (stored.version != STORAGE_VERSION)
+        return false;
+
+    for (usize i = 0; i < 3; ++i) {
+        if (not std::isfinite(stored.weights[i]) or not (stored.covariance[i][i] > 0.f))
+            return false;
+    }
+
+    m_stored = stored;
+    return true;
+}
+
+PulseWeightEstimator::Vector PulseWeightEstimator::regressors(f32 flow, f32 temperature) {
+    return { 1.f, flow - REFERENCE_FLOW, temperature - REFERENCE_TEMPERATURE };
+}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <lucas/types.h>
+#include <array>
+
+namespace lucas {
+// learns how many ml the flow sensor gives per pulse, which changes a little with the flow and the temperature of the water
+// the weight is modeled as a plane, `w0 + w1 * (flow - REFERENCE_FLOW) + w2 * (temperature - REFERENCE_TEMPERATURE)`,
+// and every pour whose real volume is known refines it by recursive least squares
+class PulseWeightEstimator {
+public:
+    struct Observation {
+        // in g/s, the average of the pour
+        f32 flow = 0.f;
+        // in celsius
+        f32 temperature = 0.f;
+        u32 pulses = 0;
+        // in ml, measured by something other than the sensor
+        f32 volume = 0.f;
+    };
+
+    // the weights used before anything is learned, usually from the hand tuned constants
+    void reset(f32 weight_at_reference_flow, f32 weight_per_flow);
+
+    // returns false if the observation was too small or too far from what's expected to be trusted
+    bool update(const Observation&);
+
+    // in ml per pulse, always within `MIN_WEIGHT` and `MAX_WEIGHT`
+    f32 weight_for(f32 flow, f32 temperature) const;
+
+    // until then the prior is all there is, and it's better to keep using the constants directly
+    bool is_trained() const { return m_stored.observations >= MIN_OBSERVATIONS; }
+
+    u32 number_of_observations() const { return m_stored.observations; }
+
+    const std::array<f32, 3>& weights() const { return m_stored.weights; }
+
+    // the layout in which the estimator is saved, the version changes whenever it does
+    struct Stored {
+        u16 version = 0;
+        u32 observations = 0;
+        std::array<f32, 3> weights = {};
+        std::array<std::array<f32, 3>, 3> covariance = {};
+    };
+
+    static constexpr u16 STORAGE_VERSION = 1;
+
+    Stored to_stored() const { return m_stored; }
+
+    // returns false if the stored estimator is from another version or doesn't make sense
+    bool load(const Stored&);
+
+    static constexpr f32 REFERENCE_FLOW = 7.5f;
+    static constexpr f32 REFERENCE_TEMPERATURE = 90.f;
+
+    // whatever is learned, a pulse is never outside these
+    static constexpr f32 MIN_WEIGHT = 0.4f;
+    static constexpr f32 MAX_WEIGHT = 0.7f;
+
+    // shorter pours have too few pulses for the rounding to be ignored
+    static constexpr u32 MIN_PULSES = 100;
+
+    static constexpr u32 MIN_OBSERVATIONS = 3;
+
+private:
+    using Vector = std::array<f32, 3>;
+
+    static Vector regressors(f32 flow, f32 temperature);
+
+    Stored m_stored;
+};
+}
@@ -3,7 +3,6 @@
 #include <lucas/lucas.h>
 #include <lucas/RecipeQueue.h>
 #include <lucas/info/info.h>
-#include <src/gcode/gcode.h>
 
 namespace lucas {
 JsonObjectConst Recipe::standard() {
@@ -57,30 +56,17 @@ JsonObjectConst Recipe::standard() {
     return doc.as<JsonObjectConst>();
 }
 
-bool Recipe::Step::collides_with(const Step& that) const {
-    if (this->starting_tick == that.starting_tick or
-        this->ending_tick() == that.ending_tick())
-        return true;
-
-    if (this->starting_tick < that.starting_tick) {
-        if (this->ending_tick() >= that.starting_tick)
-            return true;
-
-        if (that.starting_tick - this->starting_tick < util::TRAVEL_MARGIN)
-            return true;
-    } else {
-        if (this->starting_tick <= that.ending_tick())
-            return true;
-
-        if (this->ending_tick() - that.ending_tick() < util::TRAVEL_MARGIN)
-            return true;
-    }
+bool Recipe::build_from_json(JsonObjectConst json) {
+    reset();
 
-    return false;
-}
+    const auto compile_step = [](Step& step, JsonVariantConst gcode) {
+        auto command = cmd::compile_step(gcode.as<const char*>());
+        if (not command)
+            return false;
 
-void Recipe::build_from_json(JsonObjectConst json) {
-    reset();
+        step.command = *command;
+        return true;
+    };
 
     m_id = json["id"].as<Id>();
     m_finalization_duration = chrono::milliseconds{ json["finalizationTime"].as<millis_t>() };
@@ -91,22 +77,35 @@ void Recipe::build_from_json(JsonObjectConst json) {
         auto& scalding_step = m_steps[0];
 
         scalding_step.duration = scalding_obj["duration"].as<millis_t>();
-        strcpy(scalding_step.gcode, scalding_obj["gcode"].as<const char*>());
+        if (not compile_step(scalding_step, scalding_obj["gcode"])) {
+            reset();
+            return false;
+        }
 
         m_has_scalding_step = true;
     }
 
     auto attacks_obj = json["attacks"].as<JsonArrayConst>();
+    if (attacks_obj.size() == 0 or attacks_obj.size() > MAX_ATTACKS) {
+        LOG_ERR("numero de ataques invalido - [ataques = ", attacks_obj.size(), "]");
+        reset();
+        return false;
+    }
+
     for (usize i = 0; i < attacks_obj.size(); ++i) {
         auto attack_obj = attacks_obj[i];
         auto& attack = m_steps[i + m_has_scalding_step];
 
         attack.duration = attack_obj["duration"].as<millis_t>();
         attack.interval = attack_obj.containsKey("interval") ? attack_obj["interval"].as<millis_t>() : 0;
-        strcpy(attack.gcode, attack_obj["gcode"].as<const char*>());
+        if (not compile_step(attack, attack_obj["gcode"])) {
+            reset();
+            return false;
+        }
     }
 
     m_steps_size = attacks_obj.size() + m_has_scalding_step;
+    return true;
 }
 
 void Recipe::reset() {
@@ -120,7 +119,7 @@ void Recipe::reset() {
 }
 
 void Recipe::execute_current_step() {
-    GcodeSuite::process_subcommands_now(F(m_steps[m_current_step].gcode));
+    cmd::execute_step(m_steps[m_current_step].command);
     // é muito importante esse número só incrementar APÓS a execucão do step
     m_current_step++;
 }
@@ -3,6 +3,7 @@
 #include <src/MarlinCore.h>
 #include <lucas/util/Timer.h>
 #include <lucas/util/util.h>
+#include <lucas/cmd/cmd.h>
 #include <ArduinoJson.h>
 
 namespace lucas {
@@ -19,22 +20,25 @@ public:
         // o tempo de intervalo entre esse e o proximo passo
         millis_t interval = 0;
 
-        // o gcode desse passo
-        char gcode[48] = {};
+        // o gcode desse passo, já compilado
+        // @Recipe::build_from_json
+        cmd::CompiledStep command = {};
 
         millis_t ending_tick() const {
             if (starting_tick == 0)
                 return 0;
             return starting_tick + duration;
         }
-
-        bool collides_with(const Step& other) const;
     };
 
+    static constexpr auto MAX_ATTACKS = 10;            // foi decidido por marcel
+    static constexpr auto MAX_STEPS = MAX_ATTACKS + 1; // incluindo o escaldo
+
 public:
     static JsonObjectConst standard();
 
-    void build_from_json(JsonObjectConst);
+    // returns false if the recipe is malformed, in which case it's left empty
+    bool build_from_json(JsonObjectConst);
 
     Recipe(const Recipe&) = default;
     Recipe(Recipe&&) = delete;
@@ -141,8 +145,6 @@ private:
 
     bool m_has_scalding_step = false;
 
-    static constexpr auto MAX_ATTACKS = 10;            // foi decidido por marcel
-    static constexpr auto MAX_STEPS = MAX_ATTACKS + 1; // incluindo o escaldo
     // finge que isso é um vector
     std::array<Step, MAX_STEPS> m_steps = {};
     usize m_steps_size = 0;
@@ -10,47 +10,149 @@
 namespace lucas {
 void RecipeQueue::setup() {
     m_storage_handle = storage::register_handle_for_entry("recipes", sizeof(m_fixed_recipes));
-    if (auto entry = storage::fetch_entry(m_storage_handle))
-        entry->read_binary_into(m_fixed_recipes);
+    bool outdated = false;
+    if (auto entry = storage::fetch_entry(m_storage_handle)) {
+        // recipes saved by older firmwares have a different layout and can't be read
+        if (entry->size() == sizeof(m_fixed_recipes)) {
+            entry->read_binary_into(m_fixed_recipes);
+        } else {
+            outdated = true;
+        }
+    }
+
+    if (outdated) {
+        LOG_ERR("receitas fixas salvas com formato antigo, descartando");
+        storage::purge_entry(m_storage_handle);
+    }
 }
 
 void RecipeQueue::tick() {
     try_heating_hose_after_inactivity();
 
-    if (m_recipe_in_execution != Station::INVALID) {
-        if (not m_queue[m_recipe_in_execution].active) {
-            LOG_ERR("estacao executando nao possui receita na fila - [estacao = ", m_recipe_in_execution, "]");
-            m_recipe_in_execution = Station::INVALID;
+    if (m_recipe_in_execution != Station::INVALID and not m_queue[m_recipe_in_execution].active) {
+        LOG_ERR("estacao executando nao possui receita na fila - [estacao = ", m_recipe_in_execution, "]");
+        m_recipe_in_execution = Station::INVALID;
+        return;
+    }
+
+    // the deadlines that become due while the spout is moving wait for it to arrive, the queue itself keeps going
+    // except for the pump, which is started during the last part of the travel so the water is there as soon as the step begins
+    if (MotionController::the().travelling()) {
+        if (const auto pour = m_deadlines.pop_due(DeadlineQueue::Kind::Pour))
+            start_pour_ahead_of_step(pour->station);
+        return;
+    }
+
+    const auto deadline = m_deadlines.pop_due();
+    if (not deadline)
+        return;
+
+    const auto index = deadline->station;
+    auto& recipe = m_queue[index].recipe;
+    auto& station = Station::list().at(index);
+    const auto starting_tick = recipe.current_step().starting_tick;
+
+    switch (deadline->kind) {
+    case DeadlineQueue::Kind::Travel: {
+        // the spout is reserved for another station that's about to start, this one will be compensated if needed
+        if (m_recipe_in_execution != Station::INVALID and m_recipe_in_execution != index)
+            return;
+
+        // the travel deadline is scheduled from wherever the spout was at the time, which might not be where it's now
+        const auto travel_time = MotionController::the().travel_time_to_station(index);
+        if (starting_tick > millis() + travel_time) {
+            m_deadlines.schedule({ starting_tick - travel_time, index, DeadlineQueue::Kind::Travel });
             return;
         }
 
-        auto& recipe = m_queue[m_recipe_in_execution].recipe;
-        auto& station = Station::list().at(m_recipe_in_execution);
-        const auto starting_tick = recipe.current_step().starting_tick;
-        if (starting_tick == millis()) {
-            execute_current_step(recipe, station);
-        } else if (starting_tick < millis()) {
+        // o passo está chegando...
+        m_recipe_in_execution = index;
+        LOG_IF(LogQueue, "passo esta prestes a comecar - [estacao = ", index, "]");
+        MotionController::the().begin_travel_to_station(index, &RecipeQueue::spout_arrived);
+    } break;
+    case DeadlineQueue::Kind::Step: {
+        // the spout is waiting at another station, whose step is about to start, so this one has to wait for it
+        if (m_recipe_in_execution != Station::INVALID and m_recipe_in_execution != index) {
+            const auto other_starting_tick = m_queue[m_recipe_in_execution].recipe.current_step().starting_tick;
+            m_deadlines.schedule({ std::max(other_starting_tick, millis()) + 1, index, DeadlineQueue::Kind::Step });
+            return;
+        }
+
+        // the spout isn't here yet, either because the travel was skipped or because it went somewhere else in the meantime
+        // so the step is dispatched again as soon as it arrives
+        if (not MotionController::the().is_at(index)) {
+            m_recipe_in_execution = index;
+            MotionController::the().begin_travel_to_station(index, &RecipeQueue::spout_arrived);
+            m_deadlines.schedule({ millis(), index, DeadlineQueue::Kind::Step });
+            return;
+        }
+
+        const auto lateness = millis() - starting_tick;
+        const auto missed = lateness > DISPATCH_TOLERANCE;
+        m_deadlines.record_dispatch(lateness, missed);
+        LOG_IF(LogQueue, "prazo atingido - [estacao = ", index, " | atraso = ", lateness, "ms]");
+
+        if (missed) {
             compensate_for_missed_step(recipe, station);
+        } else {
+            execute_current_step(recipe, station);
         }
-    } else {
-        for_each_mapped_recipe([this](Recipe& recipe, usize index) {
-            const auto starting_tick = recipe.current_step().starting_tick;
-            // a ordem desses ifs importa por causa da subtracao de numeros unsigned, tome cuideido...
-            if (starting_tick < millis()) {
-                compensate_for_missed_step(recipe, Station::list().at(index));
-                return util::Iter::Break;
-            } else if (starting_tick - millis() <= util::TRAVEL_MARGIN) {
-                // o passo está chegando...
-                m_recipe_in_execution = index;
-                LOG_IF(LogQueue, "passo esta prestes a comecar - [estacao = ", index, "]");
-                MotionController::the().travel_to_station(index);
-                return util::Iter::Break;
-            }
-            return util::Iter::Continue;
-        });
+    } break;
+    case DeadlineQueue::Kind::Pour:
+        start_pour_ahead_of_step(index);
+        break;
     }
 }
 
+// the steps are only ever started by their deadlines, so the arrival itself is just worth noting down
+void RecipeQueue::spout_arrived(usize index) {
+    const auto& info = the().m_queue[index];
+    if (not info.active or not info.recipe.remaining_steps_are_mapped())
+        return;
+
+    const auto starting_tick = info.recipe.current_step().starting_tick;
+    const auto slack = s32(starting_tick) - s32(millis());
+    LOG_IF(LogQueue, "bico chegou na estacao - [estacao = ", index, " | folga = ", slack, "ms]");
+}
+
+void RecipeQueue::start_pour_ahead_of_step(usize index) {
+    // the spout is reserved for another station, or already pouring for something else
+    if (m_recipe_in_execution != index or Spout::the().pouring())
+        return;
+
+    const auto& step = m_queue[index].recipe.current_step();
+    const auto pour = cmd::pattern_pour_of_step(step.command);
+    if (not pour)
+        return;
+
+    // the spout went somewhere else in the meantime, so the step starts the pump itself once it gets here
+    if (not MotionController::the().heading_to(index))
+        return;
+
+    // the travel to the station might have started late, and the water can't come out before the spout is over the coffee
+    // so the pump waits until the arrival is no further away than the time the water takes to come out
+    if (const auto arrival = MotionController::the().expected_arrival()) {
+        const auto dead_time = Spout::the().pour_dead_time(pour->volume_of_water / (pour->duration / 1000.f));
+        if (*arrival > millis() + dead_time) {
+            m_deadlines.schedule({ *arrival - dead_time, index, DeadlineQueue::Kind::Pour });
+            return;
+        }
+    }
+
+    Spout::the().pour_ahead_of_pattern(pour->duration, pour->volume_of_water, step.starting_tick + pour->time_until_pattern);
+    m_pour_started_ahead_for = index;
+    LOG_IF(LogQueue, "bomba ligada antes do passo - [estacao = ", index, " | faltam = ", s32(step.starting_tick) - s32(millis()), "ms]");
+}
+
+// the step the pump was started for won't begin when expected, so neither should the water
+void RecipeQueue::abort_pour_ahead_of_step(usize index) {
+    if (m_pour_started_ahead_for != index)
+        return;
+
+    m_pour_started_ahead_for = Station::INVALID;
+    Spout::the().end_pour();
+}
+
 void RecipeQueue::schedule_recipe(JsonObjectConst recipe_json) {
     if (not recipe_json.containsKey("recipe") or
         not recipe_json.containsKey("station")) {
@@ -67,7 +169,10 @@ void RecipeQueue::schedule_recipe(JsonObjectConst recipe_json) {
     }
 
     auto& info = m_queue[station_index];
-    info.recipe.build_from_json(recipe_obj);
+    if (not info.recipe.build_from_json(recipe_obj)) {
+        LOG_ERR("receita invalida, ignorando - [estacao = ", station_index, "]");
+        return;
+    }
     schedule_recipe_for_station(info.recipe, station_index);
 }
 
@@ -99,8 +204,7 @@ void RecipeQueue::set_fixed_recipes(JsonObjectConst recipe_json) {
     for (size_t i = 0; i < recipes_array.size(); i++) {
         auto recipe_obj = recipes_array[i];
         auto& info = m_fixed_recipes[i];
-        if (not recipe_obj.isNull()) {
-            info.recipe.build_from_json(recipe_obj);
+        if (not recipe_obj.isNull() and info.recipe.build_from_json(recipe_obj)) {
             info.active = true;
             LOG_IF(LogQueue, "receita fixa setada - [estacao = ", i, "]");
         } else {
@@ -164,6 +268,17 @@ void RecipeQueue::map_station_recipe(usize index) {
         station.set_status(Station::Status(next_status), recipe.id());
         map_recipe(recipe, station);
     }
+
+    // every new recipe is a chance to plan the whole queue again
+    if (CFG(OptimizeSchedule))
+        remap_recipes_after_changes_in_queue();
+}
+
+std::optional<millis_t> RecipeQueue::time_until_next_step() const {
+    const auto tick = millis();
+    if (const auto begin = m_timeline.next_begin(tick))
+        return *begin - tick;
+    return std::nullopt;
 }
 
 void RecipeQueue::map_recipe(Recipe& recipe, Station& station) {
@@ -172,49 +287,24 @@ void RecipeQueue::map_recipe(Recipe& recipe, Station& station) {
         m_heating_hose_after_inactivity = false;
     }
 
-    util::StaticVector<millis_t, Station::MAXIMUM_NUMBER_OF_STATIONS> candidates;
-
-    // tentamos encontrar um tick inicial que não causa colisões com nenhuma das outras recipe
-    // esse processo é feito de forma bruta, homem das cavernas, mas como o número de receitas/passos é pequeno, não chega a ser um problema
-    for_each_mapped_recipe(
-        [&](const Recipe& mapped_recipe) {
-            mapped_recipe.for_each_remaining_step([&](const Recipe::Step& step) {
-                if (step.interval and step.interval < util::TRAVEL_MARGIN)
-                    return util::Iter::Continue;
-
-                // temos que sempre levar a margem de viagem em consideração quando procuramos pelo tick magico
-                for (auto interval_offset = util::TRAVEL_MARGIN; interval_offset <= step.interval - util::TRAVEL_MARGIN; interval_offset += util::TRAVEL_MARGIN) {
-                    const auto starting_tick = step.ending_tick() + interval_offset;
-                    recipe.map_remaining_steps(starting_tick);
-                    if (not collides_with_other_recipes(recipe)) {
-                        // deu boa, adicionamos o tick inicial na list de candidates
-                        candidates.push_back(starting_tick);
-                        // poderiamos parar o loop exterior aqui mas continuamos procurando em outras receitas
-                        // pois talvez exista um tick inicial melhor
-                        return util::Iter::Break;
-                    }
-                }
-                return util::Iter::Continue;
-            });
-            return util::Iter::Continue;
-        },
-        &recipe);
+    // the recipe is about to be mapped again, so its old steps shouldn't get in the way
+    m_timeline.remove(station.index());
 
     millis_t first_step_tick = 0;
-    if (not candidates.is_empty()) {
-        // pegamos o menor valor da list de candidates, para que a recipe comece o mais cedo possível
-        // obs: nao tem perigo de dar deref no iterator direto aqui
-        first_step_tick = *candidates.min();
+    if (not m_timeline.is_empty()) {
+        // the timeline finds the first gap in which every step of the recipe fits, travel times included
+        // the step can't start before the spout has had the time to get to the station
+        first_step_tick = m_timeline.earliest_fit(recipe, station.index(), millis() + MotionController::the().travel_time_to_station(station.index()));
         recipe.map_remaining_steps(first_step_tick);
     } else {
-        // se não foi achado nenhum candidato a fila está vazia
-        // então a recipe é executada imediatamente
-        MotionController::the().travel_to_station(station);
-        first_step_tick = millis();
+        // se a timeline está vazia o bico está livre
+        // então a recipe é executada assim que o bico chegar na estação, a viagem começa com o prazo dela
+        first_step_tick = millis() + MotionController::the().travel_time_to_station(station.index());
         m_recipe_in_execution = station.index();
         recipe.map_remaining_steps(first_step_tick);
     }
-    LOG_IF(LogQueue, "receita mapeada - [estacao = ", station.index(), " | candidatos = ", candidates.size(), " | tick inicial = ", first_step_tick, "]");
+    update_timeline(station.index());
+    LOG_IF(LogQueue, "receita mapeada - [estacao = ", station.index(), " | janelas = ", m_timeline.size(), " | tick inicial = ", first_step_tick, "]");
 }
 
 // this mostly serves to avoid unsigned intenger underflow
@@ -228,15 +318,17 @@ void RecipeQueue::execute_current_step(Recipe& recipe, Station& station) {
 
     const auto& current_step = recipe.current_step();
     const auto current_step_index = recipe.current_step_index();
+    // the step starts right after this, so the event is only serialized once the loop has time for it
     const auto dispatch_step_event = [](usize station, usize step, millis_t first_attack_tick, bool ending) {
-        info::send(
+        info::post(
             info::Event::Recipe,
-            [&](JsonObject o) {
+            info::Priority::Recipe,
+            info::NO_KEY,
+            [station, step, first_attack_tick, ending, tick = millis()](JsonObject o) {
                 o["station"] = station;
                 o["step"] = step;
                 o["done"] = ending;
 
-                const auto tick = millis();
                 if (tick_has_happened(first_attack_tick, tick))
                     o["timeElapsedAttacks"] = tick - first_attack_tick;
             });
@@ -246,6 +338,8 @@ void RecipeQueue::execute_current_step(Recipe& recipe, Station& station) {
         dispatch_step_event(station.index(), current_step_index, recipe.first_attack().starting_tick, false);
 
         m_recipe_in_execution = station.index();
+        // from now on the pour belongs to the step itself
+        m_pour_started_ahead_for = Station::INVALID;
 
         {
             core::TemporaryFilter f{ core::Filter::RecipeQueue }; // nada de tick()!
@@ -259,6 +353,7 @@ void RecipeQueue::execute_current_step(Recipe& recipe, Station& station) {
         }
 
         m_recipe_in_execution = Station::INVALID;
+        update_timeline(station.index());
 
         dispatch_step_event(station.index(), current_step_index, recipe.first_attack().starting_tick, true);
     }
@@ -286,6 +381,7 @@ void RecipeQueue::execute_current_step(Recipe& recipe, Station& station) {
 // nao é necessariamente executada a 1mhz, quando isso acontecer o passo atrasado é executado imediatamente
 // e todos os outros sao compensados pelo tempo de atraso
 void RecipeQueue::compensate_for_missed_step(Recipe& recipe, Station& station) {
+    abort_pour_ahead_of_step(station.index());
     MotionController::the().travel_to_station(station);
 
     const auto starting_tick = recipe.current_step().starting_tick;
@@ -295,17 +391,60 @@ void RecipeQueue::compensate_for_missed_step(Recipe& recipe, Station& station) {
     LOG_IF(LogQueue, "perdeu um passo, compensando - [estacao = ", station.index(), " | starting_tick = ", starting_tick, " | delta =  ", delta, "ms]");
 
     recipe.map_remaining_steps(millis());
+    update_timeline(station.index());
+
+    if (CFG(AbsorbDelays)) {
+        absorb_delay(recipe, delta);
+    } else {
+        for_each_mapped_recipe(
+            [this, delta](Recipe& other_recipe, usize index) {
+                other_recipe.for_each_remaining_step([delta](Recipe::Step& step) {
+                    step.starting_tick += delta;
+                    return util::Iter::Continue;
+                });
+                update_timeline(index);
+                return util::Iter::Continue;
+            },
+            &recipe);
+    }
+
     execute_current_step(recipe, station);
+}
 
+// instead of delaying every other recipe by the whole delta, each one is only pushed as far as it needs to not collide with the ones before it
+// the recipes are placed back on the timeline in the order of their next step, so the delay is absorbed by idle gaps whenever there's any
+void RecipeQueue::absorb_delay(const Recipe& late_recipe, millis_t delta) {
+    util::StaticVector<usize, Station::MAXIMUM_NUMBER_OF_STATIONS> others = {};
     for_each_mapped_recipe(
-        [delta](Recipe& other_recipe) {
-            other_recipe.for_each_remaining_step([delta](Recipe::Step& step) {
-                step.starting_tick += delta;
-                return util::Iter::Continue;
-            });
+        [&](Recipe&, usize index) {
+            others.push_back(index);
+            m_timeline.remove(index);
             return util::Iter::Continue;
         },
-        &recipe);
+        &late_recipe);
+
+    std::sort(others.begin(), others.end(), [this](usize a, usize b) {
+        return m_queue[a].recipe.current_step().starting_tick < m_queue[b].recipe.current_step().starting_tick;
+    });
+
+    millis_t propagated = 0;
+    for (auto index : others) {
+        auto& other_recipe = m_queue[index].recipe;
+        const auto starting_tick = other_recipe.current_step().starting_tick;
+        const auto shift = m_timeline.earliest_fit(other_recipe, index, starting_tick) - starting_tick;
+        if (shift) {
+            other_recipe.for_each_remaining_step([shift](Recipe::Step& step) {
+                step.starting_tick += shift;
+                return util::Iter::Continue;
+            });
+        }
+        update_timeline(index);
+        propagated += shift;
+    }
+
+    const auto absorbed = delta * others.size() > propagated ? delta * others.size() - propagated : 0;
+    m_deadlines.record_delay(absorbed, propagated);
+    LOG_IF(LogQueue, "atraso compensado - [receitas = ", others.size(), " | absorvido = ", absorbed, "ms | propagado = ", propagated, "ms]");
 }
 
 // ao ocorrer uma mudança na fila (ex: cancelar uma recipe)
@@ -321,38 +460,192 @@ void RecipeQueue::remap_recipes_after_changes_in_queue() {
             return util::Iter::Continue;
 
         recipe.unmap_steps();
+        update_timeline(index);
         recipes_to_remap.push_back(index);
 
         return util::Iter::Continue;
     });
 
+    if (CFG(OptimizeSchedule) and recipes_to_remap.size() > 1) {
+        optimize_schedule(recipes_to_remap);
+        return;
+    }
+
     for (auto index : recipes_to_remap)
         map_recipe(m_queue[index].recipe, Station::list().at(index));
 }
 
-// esse algoritmo é basicamente um hit-test 2d de cada passo da recipe nova com cada passo das receitas já mapeadas
-// é verificado se qualquer um dos passos da recipe nova colide com qualquer um dos passos de qualquer uma das receitas já mapeada
-bool RecipeQueue::collides_with_other_recipes(const Recipe& new_recipe) const {
-    bool colides = false;
-    new_recipe.for_each_remaining_step([&](const Recipe::Step& new_step, usize new_step_index) {
-        for_each_mapped_recipe(
-            [&](const Recipe& mapped_recipe, usize mapped_recipe_index) {
-                mapped_recipe.for_each_remaining_step([&](const Recipe::Step& mapped_step, usize mapped_step_index) {
-                    // se o passo comeca antes do nosso comecar uma colisao é impossivel
-                    if (mapped_step.starting_tick > (new_step.ending_tick() + util::TRAVEL_MARGIN)) {
-                        // como todos os passos sao feitos em sequencia linear podemos parar de procurar nessa recipe
-                        // ja que todos os passos subsequentes também serão depois desse
-                        return util::Iter::Break;
-                    }
-                    colides = new_step.collides_with(mapped_step);
-                    return colides ? util::Iter::Break : util::Iter::Continue;
-                });
-                return colides ? util::Iter::Break : util::Iter::Continue;
-            },
-            &new_recipe);
-        return colides ? util::Iter::Break : util::Iter::Continue;
-    });
-    return colides;
+namespace {
+// plans the starting tick of a group of recipes all at once
+// this is a branch-and-bound over the order in which the recipes are placed on the timeline, each one at the earliest gap it fits
+// the plans are compared first by the tick in which the last recipe finishes and then by the total time customers wait for their first step
+class ScheduleOptimizer {
+public:
+    struct Plan {
+        millis_t makespan = 0;
+        millis_t total_wait = 0;
+        Station::SharedData<millis_t> starting_ticks = {};
+
+        bool is_better_than(const Plan& other) const {
+            if (makespan != other.makespan)
+                return makespan < other.makespan;
+            return total_wait < other.total_wait;
+        }
+    };
+
+    void reset(const Timeline& timeline) {
+        m_timelines[0] = timeline;
+        m_entries.clear();
+        m_has_best = false;
+        m_out_of_budget = false;
+        m_nodes = 0;
+    }
+
+    void add(Recipe& recipe, usize index, millis_t not_before) {
+        m_entries.push_back({ &recipe, index, not_before });
+    }
+
+    // the recipes are explored in the order they were added, so the first complete plan is the greedy one
+    // if the budget runs out we simply keep the best plan found so far
+    const Plan& run(u32 budget_us) {
+        m_beginning = micros();
+        m_budget = budget_us;
+        branch(0, 0, {});
+        return m_best;
+    }
+
+    bool finished_search() const { return not m_out_of_budget; }
+
+    usize nodes() const { return m_nodes; }
+
+private:
+    void branch(usize depth, u32 placed, Plan partial) {
+        if (depth == m_entries.size()) {
+            if (not m_has_best or partial.is_better_than(m_best)) {
+                m_best = partial;
+                m_has_best = true;
+            }
+            return;
+        }
+
+        for (usize i = 0; i < m_entries.size(); ++i) {
+            if (placed & (1 << i))
+                continue;
+
+            if (m_has_best and micros() - m_beginning >= m_budget) {
+                m_out_of_budget = true;
+                return;
+            }
+
+            ++m_nodes;
+            auto& [recipe, index, not_before] = m_entries[i];
+            const auto starting_tick = m_timelines[depth].earliest_fit(*recipe, index, not_before);
+            recipe->map_remaining_steps(starting_tick);
+
+            auto next = partial;
+            next.starting_ticks[index] = starting_tick;
+            next.total_wait += starting_tick - not_before;
+            recipe->for_each_remaining_step([&](const Recipe::Step& step) {
+                next.makespan = std::max(next.makespan, step.ending_tick());
+                return util::Iter::Continue;
+            });
+
+            // both criteria only ever grow as more recipes are placed, so a partial plan that's already worse can't get any better
+            if (m_has_best and not next.is_better_than(m_best))
+                continue;
+
+            m_timelines[depth + 1] = m_timelines[depth];
+            m_timelines[depth + 1].insert(*recipe, index);
+            branch(depth + 1, placed | (1 << i), next);
+
+            if (m_out_of_budget)
+                return;
+        }
+    }
+
+    struct Entry {
+        Recipe* recipe;
+        usize index;
+        millis_t not_before;
+    };
+
+    util::StaticVector<Entry, Station::MAXIMUM_NUMBER_OF_STATIONS> m_entries;
+
+    // one timeline per level of the search, kept here so that they don't live on the stack
+    std::array<Timeline, Station::MAXIMUM_NUMBER_OF_STATIONS + 1> m_timelines;
+
+    Plan m_best;
+    bool m_has_best = false;
+
+    u32 m_beginning = 0;
+    u32 m_budget = 0;
+    bool m_out_of_budget = false;
+    usize m_nodes = 0;
+};
+}
+
+void RecipeQueue::optimize_schedule(std::span<const usize> indices) {
+    // the search can't take long since it blocks the whole queue
+    constexpr u32 CPU_BUDGET_US = 2000;
+
+    static ScheduleOptimizer s_optimizer;
+    s_optimizer.reset(m_timeline);
+    for (auto index : indices)
+        s_optimizer.add(m_queue[index].recipe, index, millis() + MotionController::the().travel_time_to_station(index));
+
+    const auto& plan = s_optimizer.run(CPU_BUDGET_US);
+    for (auto index : indices) {
+        m_queue[index].recipe.map_remaining_steps(plan.starting_ticks[index]);
+        update_timeline(index);
+    }
+
+    LOG_IF(LogQueue, "fila otimizada - [receitas = ", indices.size(), " | nos = ", s_optimizer.nodes(), " | completa = ", s_optimizer.finished_search(), " | makespan = ", plan.makespan, "]");
+}
+
+void RecipeQueue::update_timeline(usize index) {
+    m_deadlines.remove(index);
+    if (not m_queue[index].active) {
+        m_timeline.remove(index);
+        return;
+    }
+
+    const auto& recipe = m_queue[index].recipe;
+    m_timeline.update(recipe, index);
+
+    if (recipe.finished() or not recipe.remaining_steps_are_mapped())
+        return;
+
+    const auto& step = recipe.current_step();
+    const auto starting_tick = step.starting_tick;
+    const auto travel_time = MotionController::the().travel_time_to_station(index);
+    m_deadlines.schedule({ starting_tick > travel_time ? starting_tick - travel_time : 0, index, DeadlineQueue::Kind::Travel });
+    m_deadlines.schedule({ starting_tick, index, DeadlineQueue::Kind::Step });
+
+    // only when the pump takes longer to spin up than the step takes to get to its pattern, otherwise the step itself starts it in time
+    if (const auto pour = cmd::pattern_pour_of_step(step.command)) {
+        const auto pour_tick = Spout::the().pour_start_tick(pour->duration, pour->volume_of_water, starting_tick + pour->time_until_pattern);
+        if (pour_tick < starting_tick)
+            m_deadlines.schedule({ pour_tick, index, DeadlineQueue::Kind::Pour });
+    }
+}
+
+void RecipeQueue::send_dispatch_stats(bool reset) {
+    const auto& stats = m_deadlines.dispatch_stats();
+    info::send(
+        info::Event::Other,
+        [&stats](JsonObject o) {
+            auto obj = o.createNestedObject("dispatch");
+            obj["dispatched"] = stats.dispatched;
+            obj["missed"] = stats.missed;
+            obj["maxLateness"] = stats.max_lateness;
+            obj["absorbedDelay"] = stats.absorbed_delay;
+            obj["propagatedDelay"] = stats.propagated_delay;
+            if (stats.dispatched)
+                obj["meanLateness"] = stats.total_lateness / stats.dispatched;
+        });
+
+    if (reset)
+        m_deadlines.reset_dispatch_stats();
 }
 
 void RecipeQueue::cancel_station_recipe(usize index) {
@@ -364,6 +657,7 @@ void RecipeQueue::cancel_station_recipe(usize index) {
     remove_recipe(index);
     Station::list().at(index).set_status(Station::Status::Free);
 
+    abort_pour_ahead_of_step(index);
     if (index == m_recipe_in_execution) {
         MotionController::the().invalidate_location();
         auto& recipe = m_queue[m_recipe_in_execution].recipe;
@@ -567,5 +861,6 @@ void RecipeQueue::remove_recipe(usize index) {
 
     m_queue_size--;
     m_queue[index].active = false;
+    update_timeline(index);
 }
 }
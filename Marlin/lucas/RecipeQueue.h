@@ -3,10 +3,13 @@
 #include <lucas/Station.h>
 #include <lucas/storage/storage.h>
 #include <lucas/Recipe.h>
+#include <lucas/Timeline.h>
+#include <lucas/DeadlineQueue.h>
 #include <lucas/util/Timer.h>
 #include <lucas/util/Singleton.h>
 #include <ArduinoJson.h>
 #include <vector>
+#include <span>
 
 namespace lucas {
 class RecipeQueue : public util::Singleton<RecipeQueue> {
@@ -35,14 +38,28 @@ public:
 
     void reset_inactivity();
 
+    void send_dispatch_stats(bool reset);
+
     bool is_executing_recipe_in_station(size_t index) const {
         return m_queue[index].active;
     }
 
     bool is_executing_recipe() const { return m_recipe_in_execution != Station::INVALID; }
 
+    // `Station::INVALID` if there's no recipe being executed
+    usize station_in_execution() const { return m_recipe_in_execution; }
+
+    std::optional<Recipe::Id> id_of_recipe_in_execution() const {
+        if (not is_executing_recipe())
+            return std::nullopt;
+        return m_queue[m_recipe_in_execution].recipe.id();
+    }
+
     bool is_empty() const { return m_queue_size == 0; }
 
+    // how long until the next mapped step starts, nothing if there's none
+    std::optional<millis_t> time_until_next_step() const;
+
 public:
     void for_each_recipe(util::IterFn<const Recipe&, usize> auto&& callback, const Recipe* exception = nullptr) const {
         if (m_queue_size == 0)
@@ -133,11 +150,15 @@ private:
 
     void compensate_for_missed_step(Recipe&, Station&);
 
+    void absorb_delay(const Recipe& late_recipe, millis_t delta);
+
     void remap_recipes_after_changes_in_queue();
 
+    void optimize_schedule(std::span<const usize> indices);
+
     void try_heating_hose_after_inactivity();
 
-    bool collides_with_other_recipes(const Recipe&) const;
+    void update_timeline(usize index);
 
     void add_recipe(usize);
 
@@ -145,6 +166,12 @@ private:
 
     void recipe_was_cancelled(usize index);
 
+    static void spout_arrived(usize index);
+
+    void start_pour_ahead_of_step(usize index);
+
+    void abort_pour_ahead_of_step(usize index);
+
     usize number_of_recipes_being_executed() const;
 
 private:
@@ -165,5 +192,17 @@ private:
     std::array<RecipeInfo, Station::MAXIMUM_NUMBER_OF_STATIONS> m_queue = {};
     std::array<RecipeInfo, Station::MAXIMUM_NUMBER_OF_STATIONS> m_fixed_recipes = {};
     usize m_queue_size = 0;
+
+    // always kept in sync with the mapped steps of every recipe in the queue
+    Timeline m_timeline;
+
+    // the next travel, pour and step of every mapped recipe, kept in sync along with the timeline
+    DeadlineQueue m_deadlines;
+
+    // the station whose step the pump was started ahead of, while that step hasn't begun yet
+    usize m_pour_started_ahead_for = Station::INVALID;
+
+    // how late a step can start before it's considered missed and every other recipe has to be compensated
+    static constexpr millis_t DISPATCH_TOLERANCE = 50;
 };
 }
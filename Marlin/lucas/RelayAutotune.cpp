@@ -0,0 +1,70 @@
+#include "RelayAutotune.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace lucas {
+RelayAutotune::RelayAutotune(f32 setpoint, f32 max_output)
+    : m_setpoint(setpoint)
+    , m_max_output(max_output)
+    , m_bias(max_output / 2.f)
+    , m_amplitude(max_output / 2.f) {}
+
+f32 RelayAutotune::update(f32 temperature, millis_t now) {
+    if (not m_started) {
+        m_started = true;
+        m_cycle_start = now;
+        m_min_temperature = m_max_temperature = temperature;
+    }
+
+    m_min_temperature = std::min(m_min_temperature, temperature);
+    m_max_temperature = std::max(m_max_temperature, temperature);
+
+    if (m_heating and temperature > m_setpoint + HYSTERESIS) {
+        m_heating = false;
+        m_switched_off_at = now;
+    } else if (not m_heating and temperature < m_setpoint - HYSTERESIS) {
+        m_heating = true;
+
+        const auto time_on = f32(m_switched_off_at - m_cycle_start);
+        const auto time_off = f32(now - m_switched_off_at);
+        ++m_cycles;
+
+        const auto amplitude = (m_max_temperature - m_min_temperature) / 2.f;
+        if (m_cycles > DISCARDED_CYCLES and amplitude > HYSTERESIS) {
+            // the describing function of a relay with hysteresis
+            m_ultimate_gain_sum += 4.f * m_amplitude / (std::numbers::pi_v<f32> * std::sqrt(amplitude * amplitude - HYSTERESIS * HYSTERESIS));
+            m_ultimate_period_sum += (time_on + time_off) / 1000.f;
+            ++m_measured_cycles;
+        }
+
+        // like marlin's autotune, the bias is moved until the relay stays on and off for about as long, which makes the oscillation symmetric
+        if (time_on + time_off > 0.f) {
+            m_bias = std::clamp(m_bias + m_amplitude * (time_on - time_off) / (time_on + time_off), m_max_output * 0.1f, m_max_output * 0.9f);
+            m_amplitude = std::min(m_bias, m_max_output - m_bias);
+        }
+
+        m_cycle_start = now;
+        m_min_temperature = m_max_temperature = temperature;
+    }
+
+    return m_heating ? m_bias + m_amplitude : m_bias - m_amplitude;
+}
+
+std::optional<RelayAutotune::Gains> RelayAutotune::gains() const {
+    if (not finished() or m_measured_cycles == 0)
+        return std::nullopt;
+
+    const auto ultimate_gain = m_ultimate_gain_sum / m_measured_cycles;
+    const auto ultimate_period = m_ultimate_period_sum / m_measured_cycles;
+    if (not std::isfinite(ultimate_gain) or ultimate_gain <= 0.f or ultimate_period <= 0.f)
+        return std::nullopt;
+
+    const auto kp = ultimate_gain / 3.2f;
+    return Gains{
+        .kp = kp,
+        .ki = kp / (2.2f * ultimate_period),
+        .kd = kp * ultimate_period / 6.3f,
+    };
+}
+}
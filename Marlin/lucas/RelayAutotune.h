@@ -0,0 +1,59 @@
+#pragma once
+
+#include <lucas/types.h>
+#include <optional>
+
+namespace lucas {
+// identifies a heater from the oscillation that a relay around a setpoint makes, and computes the gains of a pid from it
+// the relay turns the output up when the temperature falls below the setpoint and down when it rises above it, the amplitude and the period of the
+// oscillation that follows give the ultimate gain and period of the plant, and the gains come from those by the tyreus-luyben rules,
+// which overshoot a lot less than ziegler-nichols on slow plants like a boiler full of water
+class RelayAutotune {
+public:
+    // in marlin's unscaled units, ki per second and kd in seconds
+    struct Gains {
+        f32 kp = 0.f;
+        f32 ki = 0.f;
+        f32 kd = 0.f;
+    };
+
+    RelayAutotune(f32 setpoint, f32 max_output);
+
+    // feeds a temperature reading, returns the output that should be applied until the next one
+    f32 update(f32 temperature, millis_t now);
+
+    bool finished() const { return m_cycles >= NUMBER_OF_CYCLES; }
+
+    usize cycles() const { return m_cycles; }
+
+    // nothing until it's finished, or if the oscillation didn't make sense
+    std::optional<Gains> gains() const;
+
+    // the first cycles start from wherever the temperature was and are ignored
+    static constexpr usize DISCARDED_CYCLES = 2;
+    static constexpr usize NUMBER_OF_CYCLES = 6;
+
+    // in celsius, the band around the setpoint in which the relay doesn't switch, so the noise of the sensor doesn't make it chatter
+    static constexpr f32 HYSTERESIS = 0.2f;
+
+private:
+    f32 m_setpoint = 0.f;
+    f32 m_max_output = 0.f;
+
+    f32 m_bias = 0.f;
+    f32 m_amplitude = 0.f;
+
+    bool m_started = false;
+    bool m_heating = true;
+    millis_t m_cycle_start = 0;
+    millis_t m_switched_off_at = 0;
+    f32 m_min_temperature = 0.f;
+    f32 m_max_temperature = 0.f;
+    usize m_cycles = 0;
+
+    // the ultimate gain and period, in seconds, summed over every cycle that was measured
+    f32 m_ultimate_gain_sum = 0.f;
+    f32 m_ultimate_period_sum = 0.f;
+    usize m_measured_cycles = 0;
+};
+}
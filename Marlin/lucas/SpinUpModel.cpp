@@ -0,0 +1,69 @@
+#include "SpinUpModel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace lucas {
+// the first samples of a band are averaged evenly, after that each new one weighs this much
+static constexpr f32 SMOOTHING = 0.2f;
+
+static void accumulate(f32& average, u16& samples, f32 value) {
+    const auto weight = std::max(1.f / (samples + 1), SMOOTHING);
+    average = std::lerp(average, value, weight);
+    if (samples < std::numeric_limits<u16>::max())
+        ++samples;
+}
+
+void SpinUpModel::add(u32 digital_signal, f32 dead_time_ms, std::optional<f32> rise_time_ms) {
+    auto& band = m_stored.bands[std::min<usize>(digital_signal / SIGNAL_PER_BAND, NUMBER_OF_BANDS - 1)];
+    accumulate(band.dead_time_ms, band.dead_time_samples, dead_time_ms);
+    if (rise_time_ms)
+        accumulate(band.rise_time_ms, band.rise_time_samples, *rise_time_ms);
+}
+
+std::optional<f32> SpinUpModel::dead_time_for(u32 digital_signal) const {
+    return interpolate(digital_signal, &Band::dead_time_ms, &Band::dead_time_samples);
+}
+
+std::optional<f32> SpinUpModel::rise_time_for(u32 digital_signal) const {
+    return interpolate(digital_signal, &Band::rise_time_ms, &Band::rise_time_samples);
+}
+
+bool SpinUpModel::is_empty() const {
+    return std::none_of(m_stored.bands.begin(), m_stored.bands.end(), [](const Band& band) {
+        return band.dead_time_samples;
+    });
+}
+
+bool SpinUpModel::load(const Stored& stored) {
+    if (stored.version != STORAGE_VERSION)
+        return false;
+
+    m_stored = stored;
+    return true;
+}
+
+std::optional<f32> SpinUpModel::interpolate(u32 digital_signal, f32 Band::*time, u16 Band::*samples) const {
+    // the times of a band are taken as the ones at its center
+    const auto position = (f32(digital_signal) - SIGNAL_PER_BAND / 2.f) / SIGNAL_PER_BAND;
+
+    std::optional<usize> below;
+    std::optional<usize> above;
+    for (usize i = 0; i < NUMBER_OF_BANDS; ++i) {
+        if (not(m_stored.bands[i].*samples))
+            continue;
+        if (f32(i) <= position)
+            below = i;
+        else if (not above)
+            above = i;
+    }
+
+    if (not below and not above)
+        return std::nullopt;
+    if (not below or not above)
+        return m_stored.bands[below ? *below : *above].*time;
+
+    const auto t = (position - *below) / f32(*above - *below);
+    return std::lerp(m_stored.bands[*below].*time, m_stored.bands[*above].*time, t);
+}
+}
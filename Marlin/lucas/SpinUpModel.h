@@ -0,0 +1,51 @@
+#pragma once
+
+#include <lucas/types.h>
+#include <array>
+#include <optional>
+
+namespace lucas {
+// how long the pump takes to get going for each digital signal, learned from the timestamps of the first pulses of every pour
+// the dead time goes from the signal being sent to the first pulse, the rise time from there to the flow getting close to the target
+// the signals are split in a few bands, each one keeping a moving average of both times
+class SpinUpModel {
+public:
+    void add(u32 digital_signal, f32 dead_time_ms, std::optional<f32> rise_time_ms);
+
+    // interpolated between the closest bands that were learned, nothing if none was
+    std::optional<f32> dead_time_for(u32 digital_signal) const;
+    std::optional<f32> rise_time_for(u32 digital_signal) const;
+
+    bool is_empty() const;
+
+    void clear() { m_stored = { .version = STORAGE_VERSION }; }
+
+    static constexpr usize NUMBER_OF_BANDS = 8;
+    static constexpr u32 SIGNAL_PER_BAND = 4096 / NUMBER_OF_BANDS;
+
+    struct Band {
+        f32 dead_time_ms = 0.f;
+        f32 rise_time_ms = 0.f;
+        u16 dead_time_samples = 0;
+        u16 rise_time_samples = 0;
+    };
+
+    // the layout in which the model is saved, the version changes whenever it does
+    struct Stored {
+        u16 version = 0;
+        std::array<Band, NUMBER_OF_BANDS> bands = {};
+    };
+
+    static constexpr u16 STORAGE_VERSION = 1;
+
+    Stored to_stored() const { return m_stored; }
+
+    // returns false if the stored model is from another version
+    bool load(const Stored&);
+
+private:
+    std::optional<f32> interpolate(u32 digital_signal, f32 Band::*time, u16 Band::*samples) const;
+
+    Stored m_stored = { .version = STORAGE_VERSION };
+};
+}
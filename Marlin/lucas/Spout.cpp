@@ -4,6 +4,7 @@
 #include <lucas/Boiler.h>
 #include <lucas/MotionController.h>
 #include <lucas/RecipeQueue.h>
+#include <lucas/PourLog.h>
 #include <lucas/info/info.h>
 
 #include <lucas/sec/sec.h>
@@ -16,6 +17,11 @@ constexpr auto EN_ON_STATE = LOW;
 constexpr auto BRK_ON_STATE = LOW;
 
 void Spout::tick() {
+    if (std::exchange(m_should_raise_volume_mismatch, false)) {
+        sec::raise_error(sec::Error::PourVolumeMismatch);
+        return;
+    }
+
     if (m_pouring) {
         const auto time_elapsed = [this] {
             return m_begin_pour_timer.elapsed();
@@ -26,9 +32,23 @@ void Spout::tick() {
             return;
         }
 
+        track_spin_up();
+
         // without a desired volume we can't correct the flow
-        // and we only start correcting after 1 full second of pouring, to give the motor enough time to spin-up
-        if (not m_total_desired_volume or time_elapsed() <= 1s)
+        if (not m_total_desired_volume)
+            return;
+
+        if (CFG(ClosedLoopPour)) {
+            control_flow();
+            return;
+        }
+
+        // the flow follows the block being executed as soon as it starts, see `Trajectory::sync_flow`
+        if (m_flow_tag != s_block_flow_tag)
+            send_flow_to_driver(m_flow);
+
+        // we only start correcting after the motor had enough time to spin-up
+        if (time_elapsed() <= spin_up_time())
             return;
 
         constexpr auto CORRECTION_INTERVAL = 1s;
@@ -44,12 +64,9 @@ void Spout::tick() {
             const auto elapsed_seconds = time_elapsed().count() / 1000.f;
             const auto duration_seconds = m_pour_duration.count() / 1000.f;
 
-            // calculate the ideal flow and fetch our best guess for it
+            // calculate the ideal flow and send our best guess for it!
             const auto ideal_flow = (m_total_desired_volume - volume_poured_so_far()) / (duration_seconds - elapsed_seconds);
-
-            // fetch the digital signal and send it!
-            const auto best_digital_signal = FlowController::the().hit_me_with_your_best_shot(ideal_flow);
-            send_digital_signal_to_driver(best_digital_signal);
+            send_flow_to_driver(ideal_flow);
         }
     } else {
         if (m_end_pour_timer >= 1s) {
@@ -66,16 +83,17 @@ void Spout::pour_with_desired_volume(millis_t duration, float desired_volume) {
 
     begin_pour(duration);
 
-    const auto flow = desired_volume / (duration / 1000);
-    const auto digital_signal = FlowController::the().hit_me_with_your_best_shot(flow);
-    send_digital_signal_to_driver(digital_signal);
+    const auto flow = desired_volume / (duration / 1000.f);
+    send_flow_to_driver(flow);
 
     m_total_desired_volume = desired_volume;
     m_correction_timer.start();
+    m_flow_loop.reset();
+    m_spinning_up = true;
 
     FlowController::the().update_flow_hint_for_pulse_calculation(flow);
 
-    if (digital_signal != FlowController::INVALID_DIGITAL_SIGNAL)
+    if (m_pouring)
         LOG_IF(LogPour, "despejo iniciado - [volume = ", desired_volume, " | sinal = ", m_digital_signal, "]");
 }
 
@@ -104,6 +122,54 @@ void Spout::pour_with_digital_signal(millis_t duration, DigitalSignal digital_si
 void Spout::setup() {
     setup_pins();
     FlowController::the().setup();
+
+    m_spin_up_storage_handle = storage::register_handle_for_entry("spinup", sizeof(SpinUpModel::Stored));
+    if (auto entry = storage::fetch_entry(m_spin_up_storage_handle)) {
+        if (not m_spin_up_model.load(entry->read_binary<SpinUpModel::Stored>()))
+            LOG_ERR("modelo de aceleracao da bomba invalido, descartando");
+    }
+}
+
+void Spout::pour_ahead_of_pattern(millis_t duration, float desired_volume, millis_t pattern_tick) {
+    if (m_pouring) {
+        LOG_IF(LogPour, "despejo ja iniciado antes do padrao");
+        return;
+    }
+
+    const auto start_tick = pour_start_tick(duration, desired_volume, pattern_tick);
+    if (const auto now = millis(); start_tick > now)
+        util::idle_for(chrono::milliseconds{ start_tick - now });
+
+    // started ahead of the pattern, the pour has to last that much longer to end along with it
+    const auto lead_time = pattern_tick > millis() ? pattern_tick - millis() : 0;
+    pour_with_desired_volume(duration + lead_time, desired_volume);
+    LOG_IF(LogPour, "despejo adiantado - [antecedencia = ", lead_time, "ms]");
+}
+
+millis_t Spout::pour_start_tick(millis_t duration, float desired_volume, millis_t pattern_tick) const {
+    const auto lead_time = pour_lead_time(desired_volume / (duration / 1000.f));
+    return pattern_tick > lead_time ? pattern_tick - lead_time : 0;
+}
+
+millis_t Spout::pour_lead_time(float flow) const {
+    const auto digital_signal = FlowController::the().hit_me_with_your_best_shot(flow);
+    const auto dead_time = m_spin_up_model.dead_time_for(digital_signal);
+    if (digital_signal == FlowController::INVALID_DIGITAL_SIGNAL or not dead_time) {
+        // before anything is learned, the same guess as always
+        const auto norm = util::normalize(flow, FlowController::FLOW_MIN, FlowController::FLOW_MAX);
+        return millis_t(std::lerp(300.f, 100.f, std::clamp(norm, 0.f, 1.f)));
+    }
+
+    // the water reaches the coffee at the end of the dead time, but only gets close to the right flow halfway through the rise
+    const auto rise_time = m_spin_up_model.rise_time_for(digital_signal).value_or(0.f);
+    return millis_t(*dead_time + rise_time / 2.f);
+}
+
+millis_t Spout::pour_dead_time(float flow) const {
+    const auto digital_signal = FlowController::the().hit_me_with_your_best_shot(flow);
+    if (digital_signal == FlowController::INVALID_DIGITAL_SIGNAL)
+        return 0;
+    return millis_t(m_spin_up_model.dead_time_for(digital_signal).value_or(0.f));
 }
 
 void Spout::setup_pins() {
@@ -118,12 +184,7 @@ void Spout::setup_pins() {
 
     // flow sensor
     pinMode(Pin::FlowSensor, INPUT);
-    attachInterrupt(
-        digitalPinToInterrupt(Pin::FlowSensor),
-        +[] {
-            ++s_pulse_counter;
-        },
-        RISING);
+    FlowSensor::the().setup(Pin::FlowSensor);
 }
 
 void Spout::send_digital_signal_to_driver(DigitalSignal v) {
@@ -133,6 +194,14 @@ void Spout::send_digital_signal_to_driver(DigitalSignal v) {
         return;
     }
 
+    if (m_pouring) {
+        account_for_signal_change();
+        if (v) {
+            m_min_signal = std::min(m_min_signal, v);
+            m_max_signal = std::max(m_max_signal, v);
+        }
+    }
+
     m_digital_signal = v;
 
     digitalWrite(Pin::EN, EN_ON_STATE);
@@ -158,47 +227,258 @@ void Spout::fill_hose(float desired_volume) {
     }
 }
 
+void Spout::control_flow() {
+    constexpr auto FLOW_LOOP_INTERVAL = 20ms;
+    // the motor is considered spun up once it reaches this fraction of the target, or after the timeout if it never does
+    constexpr auto SPIN_UP_FLOW_RATIO = 0.7f;
+
+    if (m_correction_timer < FLOW_LOOP_INTERVAL)
+        return;
+
+    const auto dt = m_correction_timer.elapsed().count() / 1000.f;
+    m_correction_timer.restart();
+
+    const auto poured = volume_poured_so_far();
+    // reached the goal too son
+    if (poured >= m_total_desired_volume) {
+        end_pour();
+        return;
+    }
+
+    // the target always aims at what's left to pour in the time that's left, so whatever was missed so far is made up for by the rest of the pour
+    const auto remaining_seconds = std::max((m_pour_duration - m_begin_pour_timer.elapsed()).count() / 1000.f, dt);
+    m_flow = (m_total_desired_volume - poured) / remaining_seconds;
+    m_flow_tag = s_block_flow_tag;
+
+    const auto target_flow = m_flow * flow_scale(m_flow_tag);
+    const auto feed_forward = FlowController::the().hit_me_with_your_best_shot(target_flow);
+    if (feed_forward == FlowController::INVALID_DIGITAL_SIGNAL) {
+        send_digital_signal_to_driver(feed_forward);
+        return;
+    }
+
+    const auto measured = measured_flow();
+
+    // the sensor has nothing useful to say while the motor spins up, so until then only the feed-forward is sent
+    if (m_spinning_up) {
+        if (measured < target_flow * SPIN_UP_FLOW_RATIO and m_begin_pour_timer < spin_up_time()) {
+            if (feed_forward != m_digital_signal)
+                send_digital_signal_to_driver(feed_forward);
+            return;
+        }
+
+        m_spinning_up = false;
+        LOG_IF(LogPour, "motor acelerou - [tempo = ", u32(m_begin_pour_timer.elapsed().count()), "ms | fluxo = ", measured, " | esperado = ", FlowController::the().expected_flow_for(m_digital_signal), "]");
+    }
+
+    const auto digital_signal = m_flow_loop.update(target_flow, measured, feed_forward, dt);
+    if (digital_signal != m_digital_signal)
+        send_digital_signal_to_driver(digital_signal);
+}
+
+void Spout::track_spin_up() {
+    constexpr auto RISE_FLOW_RATIO = 0.9f;
+    // past this the pump is either not going to reach the target or the target is out of reach, only the dead time is kept
+    constexpr auto MAX_SPIN_UP_TIME = 3s;
+    constexpr usize SAMPLES_PER_SAVE = 5;
+
+    if (not m_tracking_spin_up)
+        return;
+
+    // the signal goes out right after the pour begins
+    if (not m_starting_signal)
+        m_starting_signal = m_digital_signal;
+
+    if (not m_first_pulse_us)
+        m_first_pulse_us = FlowSensor::the().first_pulse_since(m_pour_start_us);
+
+    const auto timed_out = m_begin_pour_timer >= MAX_SPIN_UP_TIME;
+    if (not m_first_pulse_us) {
+        m_tracking_spin_up = not timed_out;
+        return;
+    }
+
+    const auto target_flow = m_flow * flow_scale(m_flow_tag);
+    const auto risen = target_flow and measured_flow() >= target_flow * RISE_FLOW_RATIO;
+    if (not risen and not timed_out)
+        return;
+
+    m_tracking_spin_up = false;
+    if (not m_starting_signal or m_starting_signal == FlowController::INVALID_DIGITAL_SIGNAL)
+        return;
+
+    const auto dead_time = (*m_first_pulse_us - m_pour_start_us) / 1000.f;
+    const auto rise_time = risen ? std::optional{ (FlowSensor::now() - *m_first_pulse_us) / 1000.f } : std::nullopt;
+    m_spin_up_model.add(m_starting_signal, dead_time, rise_time);
+    LOG_IF(LogPour, "aceleracao da bomba medida - [sinal = ", m_starting_signal, " | morto = ", dead_time, "ms | subida = ", rise_time.value_or(-1.f), "ms]");
+
+    if (++m_unsaved_spin_up_samples >= SAMPLES_PER_SAVE)
+        save_spin_up_model();
+}
+
+chrono::milliseconds Spout::spin_up_time() const {
+    // a little more than what was learned, since the motor doesn't always take the same time
+    constexpr auto MARGIN = 1.25f;
+    constexpr auto MIN_SPIN_UP_TIME = 300.f;
+    constexpr auto FALLBACK_SPIN_UP_TIME = 1s;
+
+    const auto dead_time = m_spin_up_model.dead_time_for(m_starting_signal);
+    const auto rise_time = m_spin_up_model.rise_time_for(m_starting_signal);
+    if (not m_starting_signal or not dead_time or not rise_time)
+        return FALLBACK_SPIN_UP_TIME;
+
+    const auto learned = std::clamp((*dead_time + *rise_time) * MARGIN, MIN_SPIN_UP_TIME, f32(FALLBACK_SPIN_UP_TIME.count()));
+    return chrono::milliseconds{ millis_t(learned) };
+}
+
+void Spout::save_spin_up_model() {
+    m_unsaved_spin_up_samples = 0;
+    auto entry = storage::fetch_or_create_entry(m_spin_up_storage_handle);
+    entry.write_binary(m_spin_up_model.to_stored());
+}
+
+f32 Spout::measured_flow() {
+    return FlowController::the().pulses_to_volume(1) * FlowSensor::the().instantaneous_frequency();
+}
+
+f32 Spout::flow_scale(u16 flow_tag) {
+    return flow_tag == NO_FLOW_TAG ? 1.f : f32(flow_tag) / NOMINAL_FLOW_TAG;
+}
+
+void Spout::send_flow_to_driver(float flow) {
+    m_flow = flow;
+    m_flow_tag = s_block_flow_tag;
+
+    const auto digital_signal = FlowController::the().hit_me_with_your_best_shot(flow * flow_scale(m_flow_tag));
+    // blocks are short, so consecutive tags often land on the same signal
+    if (digital_signal != m_digital_signal)
+        send_digital_signal_to_driver(digital_signal);
+}
+
 f32 Spout::volume_poured_so_far() const {
     return FlowController::the().pulses_to_volume(s_pulse_counter - m_pulses_at_start_of_pour);
 }
 
 void Spout::begin_pour(millis_t duration) {
+    // the brake is only released a second after the last pour, a pump that was still spinning says nothing about the spin-up
+    m_tracking_spin_up = not m_end_pour_timer.is_active();
+
     m_pouring = true;
     m_begin_pour_timer.start();
     m_end_pour_timer.stop();
     m_pour_duration = chrono::milliseconds{ duration };
     m_pulses_at_start_of_pour = s_pulse_counter;
+
+    m_pour_start_us = FlowSensor::now();
+    m_starting_signal = 0;
+    m_first_pulse_us.reset();
+
+    m_signal_changed_at = millis();
+    m_weighted_signal_sum = 0.f;
+    m_min_signal = std::numeric_limits<DigitalSignal>::max();
+    m_max_signal = 0;
 }
 
 void Spout::end_pour() {
     send_digital_signal_to_driver(0);
 
-    m_pouring = false;
+    const auto was_pouring = std::exchange(m_pouring, false);
 
     const auto duration = m_begin_pour_timer.elapsed();
+    const auto planned_duration = m_pour_duration;
+    const auto desired_volume = m_total_desired_volume;
     m_begin_pour_timer.stop();
     m_end_pour_timer.start();
     m_correction_timer.stop();
     m_pour_duration = {};
 
     m_total_desired_volume = 0.f;
+    m_flow = 0.f;
     m_pulses_at_end_of_pour = s_pulse_counter;
 
     const auto pulses = m_pulses_at_end_of_pour - m_pulses_at_start_of_pour;
     const auto poured_volume = FlowController::the().pulses_to_volume(pulses);
     LOG_IF(LogPour, "despejo finalizado - [duracao = ", u32(duration.count()), "ms | volume = ", poured_volume, " | pulsos = ", pulses, "]");
+
+    if (not was_pouring)
+        return;
+
+    // only a pour that actually happened tells anything about the flow, a redundant call would replace it with nothing
+    const auto seconds = duration.count() / 1000.f;
+    m_last_pour_observation = {
+        .flow = seconds ? poured_volume / seconds : 0.f,
+        .temperature = Boiler::the().temperature(),
+        .pulses = pulses,
+    };
+
+    // a pour that ends on its own either lasts its whole duration or reaches its volume
+    constexpr auto DURATION_TOLERANCE = 100ms;
+    const auto interrupted = duration + DURATION_TOLERANCE < planned_duration and poured_volume < desired_volume;
+
+    auto& queue = RecipeQueue::the();
+    const auto station = queue.station_in_execution();
+    PourLog::Record record = {
+        .ended_at = u32(millis()),
+        .duration = u32(duration.count()),
+        .pulses = pulses,
+        .desired_volume = desired_volume,
+        .measured_volume = poured_volume,
+        .min_signal = u16(m_max_signal ? m_min_signal : 0),
+        .max_signal = u16(m_max_signal),
+        .mean_signal = u16(duration.count() ? std::round(m_weighted_signal_sum / duration.count()) : 0),
+        .station = station == Station::INVALID ? PourLog::NO_STATION : u8(station),
+        .flags = u8((CFG(ClosedLoopPour) ? PourLog::ClosedLoop : 0) | (interrupted ? PourLog::Interrupted : 0)),
+        .recipe_id = queue.id_of_recipe_in_execution().value_or(0),
+    };
+    if (PourLog::the().add(record))
+        m_should_raise_volume_mismatch = true;
+}
+
+void Spout::account_for_signal_change() {
+    const auto now = millis();
+    m_weighted_signal_sum += f32(m_digital_signal) * (now - m_signal_changed_at);
+    m_signal_changed_at = now;
+}
+
+void Spout::inform_measured_volume_of_last_pour(f32 volume) {
+    if (m_pouring) {
+        LOG_ERR("volume medido durante um despejo, ignorando");
+        return;
+    }
+
+    auto observation = m_last_pour_observation;
+    observation.volume = volume;
+    FlowController::the().learn_pulse_weight(observation);
 }
 
 void Spout::FlowController::setup() {
-    m_flow_analysis_storage_handle = storage::register_handle_for_entry("flow", sizeof(m_digital_signal_table));
-    m_target_temperature_on_last_analysis_handle = storage::register_handle_for_entry("flowtemp", sizeof(s32));
+    m_curve_cache_storage_handle = storage::register_handle_for_entry("flowcache", sizeof(FlowCurveCache::Stored));
+    m_legacy_flow_analysis_storage_handle = storage::register_handle_for_entry("flow", sizeof(LegacyTable));
+    m_legacy_target_temperature_storage_handle = storage::register_handle_for_entry("flowtemp", sizeof(s32));
+
+    FlowCurveCache::Stored stored;
+    if (auto entry = storage::fetch_entry(m_curve_cache_storage_handle))
+        entry->read_binary_into(stored);
+    if (not m_curve_cache.load(stored))
+        migrate_legacy_flow_analysis();
+
+    m_pulse_weight_storage_handle = storage::register_handle_for_entry("pulse", sizeof(PulseWeightEstimator::Stored));
+    reset_pulse_weight_estimator();
+    if (auto entry = storage::fetch_entry(m_pulse_weight_storage_handle)) {
+        if (not m_pulse_weight_estimator.load(entry->read_binary<PulseWeightEstimator::Stored>()))
+            LOG_ERR("peso do pulso salvo invalido, usando as constantes");
+    }
+
+    // the session has to be saved even without a new analysis, otherwise the next one would look like this one
+    save_flow_curve_cache();
+    LOG_IF(LogCalibration, "cache de fluxo carregado - [sessao = ", m_curve_cache.session(), " | analises = ", m_curve_cache.number_of_valid_slots(), "]");
 }
 
 void Spout::FlowController::analyse_and_store_flow_data() {
     constexpr auto ITERATION_STEP = 25;
     constexpr auto INITIAL_ITERATION_STEP = 200;
 
-    clean_digital_signal_table();
+    clean_flow_curve();
     update_status(FlowAnalysisStatus::Preparing);
     const auto beginning = millis();
 
@@ -215,17 +495,39 @@ void Spout::FlowController::analyse_and_store_flow_data() {
 
         util::idle_for(2s);
         update_status(FlowAnalysisStatus::Done);
+    } else if (CFG(FastFlowAnalysis)) {
+        MotionController::the().travel_to_sewer();
+        Spout::the().fill_hose();
+
+        m_analysis_status = FlowAnalysisStatus::Executing;
+        const auto model = sample_flow_model();
+
+        Spout::the().end_pour();
+        update_status(FlowAnalysisStatus::Done);
+        if (m_abort_analysis or not model) {
+            if (not model)
+                LOG_ERR("nao foi possivel ajustar o modelo de fluxo");
+            clean_flow_curve();
+            return;
+        }
+
+        build_curve_from_model(*model);
+
+        const auto duration = millis() - beginning;
+        LOG_IF(LogCalibration, "curva preenchida pelo modelo - [duracao = ", duration / 1000.f, "s | amostras = ", model->number_of_samples, " | desvio = ", model->residual_std, "]");
+        inform_flow_model_to_host(*model, duration);
+
+        save_flow_curve_to_file(Boiler::the().target_temperature());
     } else {
         // place the spout on the sewer and fill the hose so we avoid silly errors
         MotionController::the().travel_to_sewer();
         Spout::the().fill_hose();
 
         auto minimum_flow_info = obtain_specific_flow(FLOW_MIN, { 0.f, 0 }, INITIAL_ITERATION_STEP);
-        save_flow_info_to_table(minimum_flow_info.flow, minimum_flow_info.digital_signal);
+        save_flow_info(minimum_flow_info.flow, minimum_flow_info.digital_signal);
 
         auto info_when_finished = FlowInfo{ 0.f, 0 };
         auto mod_when_finished = 0;
-        auto number_of_occupied_cells = 0;
 
         m_analysis_status = FlowAnalysisStatus::Executing;
 
@@ -265,17 +567,15 @@ void Spout::FlowController::analyse_and_store_flow_data() {
                 }
 
                 if (std::abs(info.flow - FLOW_MAX) <= 0.1) { // lucky!
-                    save_flow_info_to_table(info.flow, info.digital_signal);
-                    number_of_occupied_cells++;
+                    save_flow_info(info.flow, info.digital_signal);
                     return util::Iter::Break;
                 } else if (info.flow > FLOW_MAX) { // not so lucky
                     info_when_finished = info;
                     mod_when_finished = digital_signal_mod > 0 ? -digital_signal_mod : digital_signal_mod;
                     return util::Iter::Break;
                 } else {
-                    save_flow_info_to_table(info.flow, info.digital_signal);
+                    save_flow_info(info.flow, info.digital_signal);
                     update_progress(util::normalize(info.flow, FLOW_MIN, FLOW_MAX));
-                    number_of_occupied_cells++;
                     last_average_flow = info.flow;
                 }
 
@@ -285,27 +585,27 @@ void Spout::FlowController::analyse_and_store_flow_data() {
             ITERATION_STEP);
 
         // if we didn't find the maximum flow in the iteration above, try finding it now
-        if (m_digital_signal_table.back().back() == INVALID_DIGITAL_SIGNAL and not m_abort_analysis) {
+        if (not found_flow(FLOW_MAX) and not m_abort_analysis) {
             update_status(FlowAnalysisStatus::Finalizing);
             auto maximum_flow_info = obtain_specific_flow(FLOW_MAX, info_when_finished, mod_when_finished);
-            save_flow_info_to_table(maximum_flow_info.flow, maximum_flow_info.digital_signal);
+            save_flow_info(maximum_flow_info.flow, maximum_flow_info.digital_signal);
         }
 
         Spout::the().end_pour();
         update_status(FlowAnalysisStatus::Done);
         if (m_abort_analysis) {
-            clean_digital_signal_table();
+            clean_flow_curve();
             return;
         }
 
-        LOG_IF(LogCalibration, "tabela preenchida - [duracao = ", (millis() - beginning) / 60000.f, "min | celulas = ", number_of_occupied_cells, "]");
+        m_curve = FlowCurve::from_samples(std::span{ m_samples.begin(), m_samples.end() });
+
+        LOG_IF(LogCalibration, "curva preenchida - [duracao = ", (millis() - beginning) / 60000.f, "min | amostras = ", m_samples.size(), " | pontos = ", m_curve.size(), "]");
         LOG_IF(LogCalibration, "resultado: ");
-        for_each_occupied_cell([](DigitalSignal digital_signal, usize i, usize j) {
-            LOG_IF(LogCalibration, "[", i, "][", j, "] = ", digital_signal, " = ", i + FLOW_MIN, ".", j, "g/s");
-            return util::Iter::Continue;
-        });
+        for (const auto& knot : m_curve)
+            LOG_IF(LogCalibration, knot.digital_signal, " = ", knot.flow, "g/s");
 
-        save_digital_signal_table_to_file();
+        save_flow_curve_to_file(Boiler::the().target_temperature());
     }
 }
 
@@ -343,31 +643,126 @@ Spout::FlowController::FlowInfo Spout::FlowController::obtain_specific_flow(floa
     return result;
 }
 
+std::optional<FlowModel> Spout::FlowController::sample_flow_model() {
+    constexpr DigitalSignal FIRST_SIGNAL = 300;
+    constexpr DigitalSignal SIGNAL_STEP = 300;
+    // the legacy analysis gives up at the same point
+    constexpr DigitalSignal SIGNAL_WITHOUT_FLOW_LIMIT = 2000;
+
+    util::StaticVector<FlowModel::Sample, 4095 / SIGNAL_STEP> samples;
+    for (DigitalSignal digital_signal = FIRST_SIGNAL; digital_signal < 4095 and not samples.is_full(); digital_signal += SIGNAL_STEP) {
+        if (m_abort_analysis)
+            return std::nullopt;
+
+        Spout::the().send_digital_signal_to_driver(digital_signal);
+        const auto flow = wait_for_stable_flow();
+        LOG_IF(LogCalibration, "amostra de fluxo - [sinal = ", digital_signal, " | fluxo = ", flow, "]");
+
+        // below a certain signal the motor doesn't spin at all, those points don't belong to the curve
+        if (flow == 0.f) {
+            if (digital_signal >= SIGNAL_WITHOUT_FLOW_LIMIT) {
+                m_abort_analysis = true;
+                return std::nullopt;
+            }
+            continue;
+        }
+
+        samples.push_back({ flow, digital_signal });
+        update_progress(std::clamp(util::normalize(flow, FLOW_MIN, FLOW_MAX), 0.f, 1.f));
+
+        // one point past the top of the table is all the model needs
+        if (flow > FLOW_MAX)
+            break;
+    }
+
+    update_status(FlowAnalysisStatus::Finalizing);
+    if (samples.size() < FlowModel::MIN_SAMPLES)
+        return std::nullopt;
+
+    return FlowModel::fit(std::span{ samples.begin(), samples.end() }, FLOW_MIN, FLOW_MAX);
+}
+
+float Spout::FlowController::wait_for_stable_flow() {
+    constexpr auto CHECK_INTERVAL = 250ms;
+    constexpr millis_t MIN_SETTLING_TIME = 1500;
+    constexpr millis_t MAX_SETTLING_TIME = 6000;
+    constexpr u32 SETTLING_WINDOW_US = 1'000'000;
+    // the pulse rate is considered stable once it changes less than this between a few consecutive checks
+    constexpr auto STABILITY_THRESHOLD = 0.02f;
+    constexpr usize STABLE_CHECKS = 3;
+    constexpr auto MEASURING_TIME = 2s;
+
+    auto& sensor = FlowSensor::the();
+    const auto beginning = millis();
+    f32 last_frequency = 0.f;
+    usize stable_checks = 0;
+    while (millis() - beginning < MAX_SETTLING_TIME) {
+        util::idle_for(CHECK_INTERVAL);
+        if (m_abort_analysis)
+            return 0.f;
+
+        const auto frequency = sensor.mean_frequency(SETTLING_WINDOW_US);
+        const auto stable = last_frequency and std::abs(frequency - last_frequency) <= last_frequency * STABILITY_THRESHOLD;
+        stable_checks = stable ? stable_checks + 1 : 0;
+        last_frequency = frequency;
+
+        if (stable_checks >= STABLE_CHECKS and millis() - beginning >= MIN_SETTLING_TIME)
+            break;
+    }
+
+    // the periods between the pulses are timed to the microsecond, so even a slow flow is measured precisely in a couple seconds
+    util::idle_for(MEASURING_TIME);
+    const auto frequency = sensor.mean_frequency(chrono::duration_cast<chrono::microseconds>(MEASURING_TIME).count());
+
+    // the weight of a pulse depends on the flow itself
+    update_flow_hint_for_pulse_calculation(pulses_to_volume(1) * frequency);
+    return pulses_to_volume(1) * frequency;
+}
+
+void Spout::FlowController::build_curve_from_model(const FlowModel& model) {
+    // the model is smooth, a knot every half g/s is more than enough to follow it
+    constexpr auto KNOT_SPACING = 0.5f;
+
+    util::StaticVector<FlowModel::Sample, FlowCurve::MAX_KNOTS> knots;
+    for (auto flow = f32(FLOW_MIN); flow <= f32(FLOW_MAX) and not knots.is_full(); flow += KNOT_SPACING) {
+        const auto digital_signal = std::clamp(std::round(model.signal_for(flow)), 1.f, 4095.f);
+        knots.push_back({ flow, u32(digital_signal) });
+    }
+    m_curve = FlowCurve::from_samples(std::span{ knots.begin(), knots.end() });
+}
+
+void Spout::FlowController::inform_flow_model_to_host(const FlowModel& model, millis_t duration) const {
+    // the residuals are in signal, the slope turns them into the flow error a pour should expect
+    const auto slope = model.slope_at((FLOW_MIN + FLOW_MAX) / 2.f);
+    const auto flow_std = model.residual_std / slope;
+    info::send(
+        info::Event::Calibration,
+        [&](JsonObject o) {
+            auto obj = o.createNestedObject("model");
+            obj["samples"] = model.number_of_samples;
+            obj["degree"] = model.coefficients[2] ? 2 : 1;
+            obj["durationMs"] = duration;
+            obj["signalStd"] = model.residual_std;
+            obj["maxSignalResidual"] = model.max_residual;
+            obj["flowStd"] = flow_std;
+            // roughly 95% of the pours should be within this, in g/s
+            obj["flowConfidence"] = 2.f * flow_std;
+        });
+}
+
 // this takes a desired flow and tries to guess the best digital signal to achieve that
 Spout::DigitalSignal Spout::FlowController::hit_me_with_your_best_shot(float flow) const {
-    const auto [rounded_flow, decimal] = decompose_flow(flow);
-    const auto flow_index = rounded_flow - FLOW_MIN;
-    const auto stored_value = m_digital_signal_table[flow_index][decimal];
-    // if we already have the right value on the table just return that, no need to get fancy
-    if (stored_value != INVALID_DIGITAL_SIGNAL)
-        return stored_value;
-
-    // otherwise we get the two closest values above and below the desired flow
-    // then interpolate between them
-    // it works surprisingly well!
-    const auto [flow_below, digital_signal_below] = first_flow_info_below_flow(flow_index, decimal);
-    const auto [flow_above, digital_signal_above] = first_flow_info_above_flow(flow_index, decimal);
-
-    // if one, or both, are invalid then we can't interpolate
-    if (digital_signal_below == INVALID_DIGITAL_SIGNAL) {
-        return digital_signal_above;
-    } else if (digital_signal_above == INVALID_DIGITAL_SIGNAL) {
-        return digital_signal_below;
-    }
+    if (m_curve.is_empty())
+        return INVALID_DIGITAL_SIGNAL;
 
-    const auto normalized = util::normalize(flow, flow_below, flow_above);
-    const auto interpolated = std::lerp(float(digital_signal_below), float(digital_signal_above), normalized);
-    return DigitalSignal(std::round(interpolated));
+    // past the ends of the curve the slope of the last segment says little about the pump, so it's not extrapolated
+    const auto clamped_flow = std::clamp(flow, m_curve.min_flow(), m_curve.max_flow());
+    const auto digital_signal = std::clamp(std::round(m_curve.signal_for(clamped_flow)), 1.f, 4095.f);
+    return DigitalSignal(digital_signal);
+}
+
+float Spout::FlowController::expected_flow_for(DigitalSignal digital_signal) const {
+    return m_curve.flow_for(f32(digital_signal));
 }
 
 void Spout::FlowController::update_flow_hint_for_pulse_calculation(f32 volume_hint) {
@@ -378,38 +773,115 @@ void Spout::FlowController::update_flow_hint_for_pulse_calculation(f32 volume_hi
         FLOW_MIN,
         FLOW_MAX);
 
-    m_pulse_weight = std::lerp(MIN_ML_PER_PULSE, MAX_ML_PER_PULSE, norm);
+    if (m_pulse_weight_estimator.is_trained())
+        m_pulse_weight = m_pulse_weight_estimator.weight_for(std::clamp(volume_hint, f32(FLOW_MIN), f32(FLOW_MAX)), Boiler::the().temperature());
+    else
+        m_pulse_weight = std::lerp(MIN_ML_PER_PULSE, MAX_ML_PER_PULSE, norm);
     LOG_IF(LogCalibration, "atualizando peso do pulso - [volume = ", volume_hint, " - peso = ", m_pulse_weight, "]");
 }
 
+void Spout::FlowController::learn_pulse_weight(const PulseWeightEstimator::Observation& observation) {
+    if (not m_pulse_weight_estimator.update(observation)) {
+        LOG_IF(LogCalibration, "observacao do peso do pulso descartada - [pulsos = ", observation.pulses, " | volume = ", observation.volume, "]");
+        return;
+    }
+
+    save_pulse_weight_estimator();
+
+    const auto& weights = m_pulse_weight_estimator.weights();
+    LOG_IF(LogCalibration, "peso do pulso aprendido - [observacoes = ", m_pulse_weight_estimator.number_of_observations(), " | peso = ", weights[0], " | por fluxo = ", weights[1], " | por grau = ", weights[2], "]");
+}
+
+void Spout::FlowController::forget_pulse_weight() {
+    reset_pulse_weight_estimator();
+    save_pulse_weight_estimator();
+    LOG_IF(LogCalibration, "peso do pulso aprendido esquecido");
+}
+
+void Spout::FlowController::reset_pulse_weight_estimator() {
+    // the prior is the same line the constants describe, only written around the reference flow
+    const auto weight_per_flow = f32(MAX_ML_PER_PULSE - MIN_ML_PER_PULSE) / (FLOW_MAX - FLOW_MIN);
+    const auto weight_at_reference_flow = f32(MIN_ML_PER_PULSE) + weight_per_flow * (PulseWeightEstimator::REFERENCE_FLOW - FLOW_MIN);
+    m_pulse_weight_estimator.reset(weight_at_reference_flow, weight_per_flow);
+}
+
+void Spout::FlowController::save_pulse_weight_estimator() {
+    auto entry = storage::fetch_or_create_entry(m_pulse_weight_storage_handle);
+    entry.write_binary(m_pulse_weight_estimator.to_stored());
+}
+
 f32 Spout::FlowController::pulses_to_volume(u32 pulses) const {
     return pulses * m_pulse_weight;
 }
 
 void Spout::FlowController::firmware_upgrade_finished() {
-    storage::purge_entry(m_flow_analysis_storage_handle);
-    storage::purge_entry(m_target_temperature_on_last_analysis_handle);
+    // the new firmware may drive the pump differently, so none of the analyses can be trusted
+    m_curve_cache.invalidate_all();
+    save_flow_curve_cache();
 }
 
-void Spout::FlowController::clean_digital_signal_table() {
-    for (auto& t : m_digital_signal_table)
-        std::fill(t.begin(), t.end(), INVALID_DIGITAL_SIGNAL);
+void Spout::FlowController::clean_flow_curve() {
+    m_curve.clear();
+    m_samples.clear();
 
     m_analysis_progress = 0.f;
     m_analysis_status = FlowAnalysisStatus::None;
 }
 
-void Spout::FlowController::save_digital_signal_table_to_file() {
-    auto entry = storage::fetch_or_create_entry(m_flow_analysis_storage_handle);
-    entry.write_binary(m_digital_signal_table);
+void Spout::FlowController::save_flow_curve_to_file(s32 target_temperature) {
+    m_curve_cache.store(target_temperature, m_curve);
+    save_flow_curve_cache();
+}
+
+bool Spout::FlowController::load_flow_curve_for(s32 target_temperature, bool trust_previous_sessions) {
+    const auto lookup = m_curve_cache.find(target_temperature, trust_previous_sessions, CFG(InterpolateFlowCurves));
+    if (not lookup)
+        return false;
+
+    m_curve = lookup->curve;
+    LOG_IF(LogCalibration, "curva de fluxo reutilizada - [temperatura = ", target_temperature, " | ", lookup->match == FlowCurveCache::Match::Exact ? "exata" : "interpolada", " | pontos = ", m_curve.size(), "]");
+    return true;
+}
 
-    entry = storage::fetch_or_create_entry(m_target_temperature_on_last_analysis_handle);
-    entry.write_binary(Boiler::the().target_temperature());
+void Spout::FlowController::save_flow_curve_cache() {
+    auto entry = storage::fetch_or_create_entry(m_curve_cache_storage_handle);
+    entry.write_binary(m_curve_cache.to_stored());
 }
 
-void Spout::FlowController::fetch_digital_signal_table_from_file() {
-    if (auto entry = storage::fetch_entry(m_flow_analysis_storage_handle))
-        entry->read_binary_into(m_digital_signal_table);
+void Spout::FlowController::migrate_legacy_flow_analysis() {
+    auto entry = storage::fetch_entry(m_legacy_flow_analysis_storage_handle);
+    auto temperature_entry = storage::fetch_entry(m_legacy_target_temperature_storage_handle);
+    if (not entry or not temperature_entry)
+        return;
+
+    FlowCurve curve;
+    // the table came before the curve, both may still be around
+    if (entry->size() == sizeof(LegacyTable)) {
+        LegacyTable table;
+        entry->read_binary_into(table);
+
+        m_samples.clear();
+        for (usize i = 0; i < table.size(); ++i) {
+            for (usize j = 0; j < table[i].size(); ++j) {
+                if (table[i][j] != INVALID_DIGITAL_SIGNAL and not m_samples.is_full())
+                    m_samples.push_back({ f32(i + FLOW_MIN) + f32(j) / 10.f, table[i][j] });
+            }
+        }
+
+        curve = FlowCurve::from_samples(std::span{ m_samples.begin(), m_samples.end() });
+        m_samples.clear();
+    } else if (auto stored_curve = FlowCurve::from_stored(entry->read_binary<FlowCurve::Stored>())) {
+        curve = *stored_curve;
+    }
+
+    const auto target_temperature = temperature_entry->read_binary<s32>();
+    if (not curve.is_empty()) {
+        m_curve_cache.store_from_previous_session(target_temperature, curve);
+        LOG_IF(LogCalibration, "analise de fluxo antiga migrada - [temperatura = ", target_temperature, " | pontos = ", curve.size(), "]");
+    }
+
+    storage::purge_entry(m_legacy_flow_analysis_storage_handle);
+    storage::purge_entry(m_legacy_target_temperature_storage_handle);
 }
 
 void Spout::FlowController::inform_progress_to_host() const {
@@ -417,12 +889,17 @@ void Spout::FlowController::inform_progress_to_host() const {
         return;
 
     if (m_analysis_status == FlowAnalysisStatus::Executing) {
-        info::send(
+        // the analysis reports its progress at every sample, the host only needs the latest one
+        info::post(
             info::Event::Calibration,
-            [this](JsonObject o) {
-                o["progress"] = m_analysis_progress;
+            info::Priority::Telemetry,
+            0,
+            [progress = m_analysis_progress](JsonObject o) {
+                o["progress"] = progress;
             });
     } else {
+        // a change of status goes out after the progress that came before it
+        info::flush_queued_events();
         info::send(
             info::Event::Calibration,
             [this](JsonObject o) {
@@ -430,45 +907,4 @@ void Spout::FlowController::inform_progress_to_host() const {
             });
     }
 }
-
-std::optional<s32> Spout::FlowController::last_analysis_target_temperature() const {
-    if (auto entry = storage::fetch_entry(m_target_temperature_on_last_analysis_handle))
-        return entry->read_binary<s32>();
-
-    return std::nullopt;
-}
-
-Spout::FlowController::FlowInfo Spout::FlowController::first_flow_info_below_flow(s32 flow_index, s32 decimal) const {
-    for (; flow_index >= 0; --flow_index, decimal = 9) {
-        const auto& cells = m_digital_signal_table[flow_index];
-        for (; decimal >= 0; --decimal) {
-            if (cells[decimal] != INVALID_DIGITAL_SIGNAL) {
-                const auto flow = float(flow_index + FLOW_MIN) + float(decimal) / 10.f;
-                return { flow, cells[decimal] };
-            }
-        }
-    }
-
-    return { 0.f, INVALID_DIGITAL_SIGNAL };
-}
-
-Spout::FlowController::FlowInfo Spout::FlowController::first_flow_info_above_flow(s32 flow_index, s32 decimal) const {
-    for (; flow_index < FLOW_RANGE; ++flow_index, decimal = 0) {
-        const auto& cells = m_digital_signal_table[flow_index];
-        for (; decimal < 10; ++decimal) {
-            if (cells[decimal] != INVALID_DIGITAL_SIGNAL) {
-                const auto flow = float(flow_index + FLOW_MIN) + float(decimal) / 10.f;
-                return { flow, cells[decimal] };
-            }
-        }
-    }
-
-    return { 0.f, INVALID_DIGITAL_SIGNAL };
-}
-
-Spout::FlowController::DecomposedFlow Spout::FlowController::decompose_flow(float flow) const {
-    const auto rounded = std::round(flow * 10.f) / 10.f;
-    const auto clamped = std::clamp(rounded, float(FLOW_MIN), float(FLOW_MAX) - 0.1f);
-    return { s32(clamped), s32(clamped * 10) % 10 };
-}
 }
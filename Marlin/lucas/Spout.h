@@ -6,6 +6,13 @@
 #include <lucas/lucas.h>
 #include <lucas/util/Timer.h>
 #include <lucas/util/Singleton.h>
+#include <lucas/FlowLoop.h>
+#include <lucas/FlowSensor.h>
+#include <lucas/FlowModel.h>
+#include <lucas/FlowCurve.h>
+#include <lucas/FlowCurveCache.h>
+#include <lucas/PulseWeightEstimator.h>
+#include <lucas/SpinUpModel.h>
 
 namespace lucas {
 class Station;
@@ -46,6 +53,20 @@ public:
         return pour_with_digital_signal_and_wait(ms, digital_signal);
     }
 
+    // starts the pour early enough for the water to reach the coffee right as the pattern begins at `pattern_tick`, and keeps it going until the pattern ends
+    // if the pump takes less to spin up than the spout takes to get there, waits for the right moment first
+    // does nothing if the pump was already started for the pattern, see `RecipeQueue::start_pour_ahead_of_step`
+    void pour_ahead_of_pattern(millis_t duration, float desired_volume, millis_t pattern_tick);
+
+    // the tick in which the pump has to be started for the water to reach the coffee at `pattern_tick`
+    millis_t pour_start_tick(millis_t duration, float desired_volume, millis_t pattern_tick) const;
+
+    // how long before the water should hit the coffee the pump has to be started to pour `flow`
+    millis_t pour_lead_time(float flow) const;
+
+    // how long after the pump is started the water starts coming out when pouring `flow`, 0 if it hasn't been learned yet
+    millis_t pour_dead_time(float flow) const;
+
     void end_pour();
 
     void setup();
@@ -54,7 +75,21 @@ public:
 
     bool pouring() const { return m_pouring; }
 
-    static volatile inline u32 s_pulse_counter = 0;
+    FlowLoop& flow_loop() { return m_flow_loop; }
+
+    // the pulses of the flow sensor, kept here for everything that only needs to count them
+    static inline volatile u32& s_pulse_counter = FlowSensor::s_pulse_counter;
+
+    // the flow tag of the planner block being executed, written by the stepper as soon as the block starts
+    // a tag is the scale of the flow in thousandths, which lets a pour follow the speed of the spout along a pattern
+    static volatile inline u16 s_block_flow_tag = 0;
+
+    static constexpr u16 NO_FLOW_TAG = 0;
+    static constexpr u16 NOMINAL_FLOW_TAG = 1000;
+
+    static u16 flow_tag_for_scale(f32 scale) {
+        return u16(std::clamp(std::round(scale * NOMINAL_FLOW_TAG), 1.f, 65535.f));
+    }
 
     class FlowController : public util::Singleton<FlowController> {
     public:
@@ -64,9 +99,13 @@ public:
 
         void analyse_and_store_flow_data();
 
-        void clean_digital_signal_table();
-        void save_digital_signal_table_to_file();
-        void fetch_digital_signal_table_from_file();
+        void clean_flow_curve();
+
+        // the curve is cached under the temperature it was analysed with, replacing any older analysis of the same temperature
+        void save_flow_curve_to_file(s32 target_temperature);
+
+        // returns false if no analysis in the cache fits the temperature, exactly or between two close ones
+        bool load_flow_curve_for(s32 target_temperature, bool trust_previous_sessions);
 
         static void inform_flow_analysis_status() {
             core::inform_calibration_status();
@@ -97,12 +136,19 @@ public:
         void set_abort_analysis(bool b) { m_abort_analysis = b; }
         bool abort_analysis() const { return m_abort_analysis; }
 
-        std::optional<s32> last_analysis_target_temperature() const;
-
         DigitalSignal hit_me_with_your_best_shot(float flow) const;
 
+        // the inverse of `hit_me_with_your_best_shot`, the flow the curve expects from a signal
+        float expected_flow_for(DigitalSignal) const;
+
         void update_flow_hint_for_pulse_calculation(f32 volume_hint);
 
+        // teaches the pulse weight with a pour whose real volume was measured by something other than the sensor
+        void learn_pulse_weight(const PulseWeightEstimator::Observation&);
+
+        // goes back to the hand tuned constants
+        void forget_pulse_weight();
+
         f32 pulses_to_volume(u32 pulses) const;
 
         void firmware_upgrade_finished();
@@ -114,16 +160,18 @@ public:
         static constexpr auto FLOW_MAX = 13;
         static constexpr auto FLOW_RANGE = FLOW_MAX - FLOW_MIN;
         static constexpr auto NUMBER_OF_CELLS = FLOW_RANGE * 10;
-        // TODO: turn this into a single-dimensional array
-        using Table = std::array<std::array<DigitalSignal, 10>, FLOW_RANGE>;
 
-        static_assert(sizeof(Table) == sizeof(DigitalSignal) * NUMBER_OF_CELLS, "unexpected table size");
+        // how older firmwares stored the flow analysis, only ever read to migrate it to a curve
+        // a cell per 0.1 g/s between FLOW_MIN and FLOW_MAX, with INVALID_DIGITAL_SIGNAL for the flows that were never found
+        using LegacyTable = std::array<std::array<DigitalSignal, 10>, FLOW_RANGE>;
+
+        static_assert(sizeof(LegacyTable) == sizeof(DigitalSignal) * NUMBER_OF_CELLS, "unexpected table size");
 
     private:
         friend class util::Singleton<FlowController>;
 
         FlowController() {
-            clean_digital_signal_table();
+            clean_flow_curve();
         }
 
         struct FlowInfo {
@@ -174,41 +222,40 @@ public:
 
         FlowInfo obtain_specific_flow(float flow, FlowInfo starting_flow_info, s32 starting_mod);
 
-        FlowInfo first_flow_info_below_flow(s32 flow_index, s32 decimal) const;
-        FlowInfo first_flow_info_above_flow(s32 flow_index, s32 decimal) const;
+        // samples a few signals spread over the whole range of the pump and fits a model to them, instead of walking the signal cell by cell
+        std::optional<FlowModel> sample_flow_model();
 
-        struct DecomposedFlow {
-            s32 rounded_flow;
-            s32 decimal;
-        };
+        // waits for the pulse rate to settle on the signal that's being sent, then measures the flow
+        float wait_for_stable_flow();
 
-        DecomposedFlow decompose_flow(float flow) const;
+        void build_curve_from_model(const FlowModel&);
 
-        void save_flow_info_to_table(float flow, DigitalSignal signal) {
-            auto [rounded_flow, decimal] = decompose_flow(flow);
-            m_digital_signal_table[rounded_flow - FLOW_MIN][decimal] = signal;
-            LOG_IF(LogCalibration, "fluxo info salva - [sinal = ", signal, ", index1 = ", rounded_flow - FLOW_MIN, ", index2 = ", decimal, "]");
+        void inform_flow_model_to_host(const FlowModel&, millis_t duration) const;
+
+        void save_flow_curve_cache();
+
+        void reset_pulse_weight_estimator();
+        void save_pulse_weight_estimator();
+
+        // older firmwares stored a single analysis, in "flow" and "flowtemp", which becomes the first entry of the cache
+        void migrate_legacy_flow_analysis();
+
+        void save_flow_info(float flow, DigitalSignal signal) {
+            if (not m_samples.is_full())
+                m_samples.push_back({ flow, signal });
+            LOG_IF(LogCalibration, "fluxo info salva - [sinal = ", signal, " | fluxo = ", flow, "]");
         }
 
-        void for_each_occupied_cell(util::IterFn<DigitalSignal, usize, usize> auto&& callback) const {
-            for (usize i = 0; i < m_digital_signal_table.size(); ++i) {
-                auto& cells = m_digital_signal_table[i];
-                for (usize j = 0; j < cells.size(); ++j) {
-                    auto digital_signal = cells[j];
-                    if (digital_signal != INVALID_DIGITAL_SIGNAL)
-                        if (std::invoke(callback, digital_signal, i, j) == util::Iter::Break)
-                            return;
-                }
-            }
+        bool found_flow(float flow) const {
+            return std::any_of(m_samples.begin(), m_samples.end(), [flow](const FlowModel::Sample& sample) {
+                return std::abs(sample.flow - flow) <= 0.1f;
+            });
         }
 
-        // this table is like a map-like matrix of the digital values that produce a specific flow between FLOW_MIN and FLOW_MAX, with 1 digit of precision
-        // the values are accessed using 'whole number - FLOW_MIN' as the index to the first array and the decimal as the index to the second
-        // @ref decompose_flow
-        // for example, assuming FLOW_MIN == 5:
-        // 		- the cell for the flow '5.5 g/s' is located at 'table[0][5]'
-        // 		- the cell for the flow '10.3 g/s' is located at 'table[5][3]'
-        Table m_digital_signal_table;
+        // the flows found by the analysis so far, which become the curve once it's done
+        util::StaticVector<FlowModel::Sample, FlowCurve::MAX_SAMPLES> m_samples;
+
+        FlowCurve m_curve;
 
         FlowAnalysisStatus m_analysis_status = FlowAnalysisStatus::None;
 
@@ -216,15 +263,26 @@ public:
 
         bool m_abort_analysis = false;
 
-        storage::Handle m_flow_analysis_storage_handle;
+        FlowCurveCache m_curve_cache;
+
+        storage::Handle m_curve_cache_storage_handle;
 
-        storage::Handle m_target_temperature_on_last_analysis_handle;
+        storage::Handle m_legacy_flow_analysis_storage_handle;
+
+        storage::Handle m_legacy_target_temperature_storage_handle;
 
         f32 m_pulse_weight = 0.f;
+
+        PulseWeightEstimator m_pulse_weight_estimator;
+
+        storage::Handle m_pulse_weight_storage_handle;
     };
 
     void send_digital_signal_to_driver(DigitalSignal);
 
+    // the real volume of the last pour, weighed by the host, which the flow controller learns the pulse weight from
+    void inform_measured_volume_of_last_pour(f32 volume);
+
 private:
     void begin_pour(millis_t duration);
 
@@ -232,9 +290,34 @@ private:
 
     f32 volume_poured_so_far() const;
 
+    // sends the best signal for the flow, scaled by the flow tag of the current block
+    void send_flow_to_driver(float flow);
+
+    // a step of the closed loop that keeps the flow on target, used instead of the once a second correction
+    void control_flow();
+
+    // in g/s, from the period between the last flow sensor pulses
+    f32 measured_flow();
+
+    static f32 flow_scale(u16 flow_tag);
+
+    // measures the dead and rise times of a pour that started with the pump stopped, see `SpinUpModel`
+    void track_spin_up();
+
+    // how long the flow takes to be worth correcting for the signal the pour started with
+    chrono::milliseconds spin_up_time() const;
+
+    void save_spin_up_model();
+
+    // the signal of the pour so far, kept for its record in `PourLog`
+    void account_for_signal_change();
+
     u32 m_pulses_at_start_of_pour = 0;
     u32 m_pulses_at_end_of_pour = 0;
 
+    // what the pulse weight is learned from, kept until the next pour ends
+    PulseWeightEstimator::Observation m_last_pour_observation;
+
     chrono::milliseconds m_pour_duration;
 
     float m_total_desired_volume = 0.f;
@@ -245,6 +328,29 @@ private:
 
     DigitalSignal m_digital_signal = 0;
 
+    float m_flow = 0.f;
+    u16 m_flow_tag = NO_FLOW_TAG;
+
+    FlowLoop m_flow_loop;
+    bool m_spinning_up = false;
+
+    SpinUpModel m_spin_up_model;
+    storage::Handle m_spin_up_storage_handle;
+    usize m_unsaved_spin_up_samples = 0;
+
+    bool m_tracking_spin_up = false;
+    u32 m_pour_start_us = 0;
+    DigitalSignal m_starting_signal = 0;
+    std::optional<u32> m_first_pulse_us;
+
+    millis_t m_signal_changed_at = 0;
+    f32 m_weighted_signal_sum = 0.f;
+    DigitalSignal m_min_signal = 0;
+    DigitalSignal m_max_signal = 0;
+
+    // the error can't be raised from inside `end_pour`, since raising it ends the pour too
+    bool m_should_raise_volume_mismatch = false;
+
     bool m_pouring = false;
 };
 }
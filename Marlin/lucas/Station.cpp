@@ -137,8 +137,8 @@ void Station::update_leds() {
 }
 
 float Station::absolute_position(usize index) {
-    const auto first_station_abs_pos = 85.f / MotionController::the().step_ratio_x();
-    const auto distance_between_each_station = 160.f / MotionController::the().step_ratio_x();
+    const auto first_station_abs_pos = 85.f;
+    const auto distance_between_each_station = 160.f;
     return first_station_abs_pos + index * distance_between_each_station;
 }
 
@@ -202,11 +202,14 @@ void Station::set_status(Status status, std::optional<Recipe::Id> recipe_id) {
 
     m_status = status;
 
-    info::send(
+    // only the latest status of each station goes out, a recipe can go through a few of them in the same tick
+    info::post(
         info::Event::Station,
-        [this, &recipe_id](JsonObject o) {
-            o["station"] = index();
-            o["status"] = s32(m_status);
+        info::Priority::Recipe,
+        u16(index()),
+        [station = index(), status, recipe_id](JsonObject o) {
+            o["station"] = station;
+            o["status"] = s32(status);
             o["currentTemp"] = Boiler::the().temperature();
             if (recipe_id)
                 o["recipeId"] = *recipe_id;
@@ -0,0 +1,96 @@
+#include "Timeline.h"
+#include <lucas/lucas.h>
+#include <lucas/MotionController.h>
+
+namespace lucas {
+void Timeline::insert(const Recipe& recipe, usize station) {
+    recipe.for_each_remaining_step([&](const Recipe::Step& step) {
+        if (step.starting_tick == 0)
+            return util::Iter::Continue;
+
+        if (m_windows.is_full()) {
+            LOG_ERR("timeline cheia - [estacao = ", station, "]");
+            return util::Iter::Break;
+        }
+
+        const auto window = Window{ step.starting_tick, step.ending_tick(), station };
+        const auto position = std::upper_bound(m_windows.begin(), m_windows.end(), window.begin, [](millis_t begin, const Window& w) {
+            return begin < w.begin;
+        });
+        m_windows.insert(position, window);
+        return util::Iter::Continue;
+    });
+}
+
+void Timeline::remove(usize station) {
+    m_windows.erase_if([station](const Window& w) {
+        return w.station == station;
+    });
+}
+
+std::optional<millis_t> Timeline::next_begin(millis_t tick) const {
+    const auto it = std::find_if(m_windows.begin(), m_windows.end(), [tick](const Window& w) {
+        return w.begin >= tick;
+    });
+    return it != m_windows.end() ? std::optional{ it->begin } : std::nullopt;
+}
+
+void Timeline::update(const Recipe& recipe, usize station) {
+    remove(station);
+    insert(recipe, station);
+}
+
+millis_t Timeline::earliest_fit(const Recipe& recipe, usize station, millis_t not_before) const {
+    struct Offset {
+        millis_t offset;
+        millis_t duration;
+    };
+
+    // the steps of a recipe are always executed in a linear sequence, so their position relative to the first one never changes
+    util::StaticVector<Offset, Recipe::MAX_STEPS> offsets;
+    millis_t offset = 0;
+    recipe.for_each_remaining_step([&](const Recipe::Step& step) {
+        offsets.push_back({ offset, step.duration });
+        offset += step.duration + step.interval;
+        return util::Iter::Continue;
+    });
+
+    // every collision pushes the candidate forward to right after the window that caused it, plus the travel from there
+    // since the candidate only ever moves forward, and every window is passed at most once, this always terminates
+    const auto& motion = MotionController::the();
+    auto candidate = not_before;
+    for (usize i = 0; i < offsets.size();) {
+        const auto& step = offsets[i];
+        const auto beginning = candidate + step.offset;
+        if (const auto other = collision({ beginning, beginning + step.duration, station })) {
+            candidate = other->end + motion.travel_time(other->station, station) - step.offset;
+            i = 0;
+            continue;
+        }
+        ++i;
+    }
+
+    return candidate;
+}
+
+// the windows never overlap each other, which means they're sorted by their ending tick too
+const Timeline::Window* Timeline::collision(const Window& window) const {
+    const auto& motion = MotionController::the();
+    const auto next = std::upper_bound(m_windows.begin(), m_windows.end(), window.begin, [](millis_t begin, const Window& w) {
+        return begin < w.begin;
+    });
+
+    if (next != m_windows.begin()) {
+        const auto& previous = *std::prev(next);
+        if (previous.end + motion.travel_time(previous.station, window.station) > window.begin)
+            return &previous;
+    }
+
+    if (next != m_windows.end()) {
+        if (window.end + motion.travel_time(window.station, next->station) > next->begin)
+            return next;
+    }
+
+    return nullptr;
+}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <lucas/Recipe.h>
+#include <lucas/Station.h>
+#include <lucas/util/StaticVector.h>
+
+namespace lucas {
+// the occupancy of the spout over time, kept as a sorted list of the windows in which it's busy
+// two windows are only compatible if the gap between them is enough for the spout to travel from one station to the other
+class Timeline {
+public:
+    struct Window {
+        millis_t begin = 0;
+        millis_t end = 0;
+        usize station = Station::INVALID;
+    };
+
+    // adds the windows of every mapped remaining step of the recipe
+    void insert(const Recipe&, usize station);
+
+    void remove(usize station);
+
+    // the same as `remove` followed by `insert`, used whenever the steps of a recipe are (re)mapped
+    void update(const Recipe&, usize station);
+
+    void clear() { m_windows.clear(); }
+
+    // finds the earliest tick, not before `not_before`, in which all the remaining steps of the recipe fit
+    // the recipe itself must not be in the timeline when this is called
+    millis_t earliest_fit(const Recipe&, usize station, millis_t not_before) const;
+
+    bool is_empty() const { return m_windows.is_empty(); }
+
+    usize size() const { return m_windows.size(); }
+
+    // the beginning of the first window that hasn't begun yet at `tick`, if there's any
+    std::optional<millis_t> next_begin(millis_t tick) const;
+
+    static constexpr usize MAX_WINDOWS = Station::MAXIMUM_NUMBER_OF_STATIONS * Recipe::MAX_STEPS;
+
+private:
+    // returns the window that collides with the given one, if there's any
+    // only the neighbours need to be checked, since travelling through a station is never faster than going straight to the destination
+    const Window* collision(const Window&) const;
+
+    util::StaticVector<Window, MAX_WINDOWS> m_windows;
+};
+}
@@ -0,0 +1,98 @@
+#include "Trajectory.h"
+#include <lucas/Spout.h>
+#include <src/module/planner.h>
+#include <numbers>
+#include <algorithm>
+#include <cmath>
+
+namespace lucas {
+static f32 angle_at(const Spiral& spiral, f32 t) {
+    const auto direction = spiral.clockwise ? -1.f : 1.f;
+    return spiral.start_angle + direction * 2.f * std::numbers::pi_v<f32> * spiral.turns * t;
+}
+
+f32 Spiral::x_at(f32 t) const {
+    return radius_at(t) * std::cos(angle_at(*this, t));
+}
+
+f32 Spiral::y_at(f32 t) const {
+    return radius_at(t) * std::sin(angle_at(*this, t));
+}
+
+bool SpiralSegments::next() {
+    if (m_t >= 1.f)
+        return false;
+
+    // how fast the position changes with `t`, used to turn the desired segment length into a step in `t`
+    const auto radial_speed = m_spiral.end_radius - m_spiral.start_radius;
+    const auto tangential_speed = m_spiral.radius_at(m_t) * 2.f * std::numbers::pi_v<f32> * m_spiral.turns;
+    const auto speed = std::sqrt(radial_speed * radial_speed + tangential_speed * tangential_speed);
+    if (speed == 0.f) {
+        m_t = 1.f;
+        return false;
+    }
+
+    // the longest chord that stays within the tolerance of a circle with the current radius
+    const auto chord = std::sqrt(8.f * CHORD_TOLERANCE * m_spiral.radius_at(m_t));
+    const auto length = std::clamp(chord, MIN_SEGMENT_LENGTH, MAX_SEGMENT_LENGTH);
+    m_t = std::min(m_t + length / speed, 1.f);
+    return true;
+}
+
+bool Trajectory::line_to(f32 x, f32 y) {
+    auto target = m_center;
+    target.x += x;
+    target.y += y * m_y_scale;
+    if (m_average_speed)
+        planner.next_flow_tag = flow_tag_for_segment(x - m_x, (y - m_y) * m_y_scale);
+
+    if (not planner.buffer_line(target, m_feedrate))
+        return false;
+
+    current_position = target;
+    m_x = x;
+    m_y = y;
+    return true;
+}
+
+u16 Trajectory::flow_tag_for_segment(f32 dx, f32 dy) {
+    const auto length = std::sqrt(dx * dx + dy * dy);
+    const auto last_length = std::sqrt(m_last_dx * m_last_dx + m_last_dy * m_last_dy);
+    const auto acceleration = planner.settings.travel_acceleration;
+
+    // the spout starts and ends the path stopped, so the segments close to either end are slower
+    const auto middle = m_travelled + length / 2.f;
+    auto speed = std::min({ m_feedrate,
+                            std::sqrt(2.f * acceleration * middle),
+                            std::sqrt(2.f * acceleration * std::max(m_path_length - middle, 0.f)) });
+
+    // and the planner never takes a junction faster than a circle through it allows, `v^2 = a * r`
+    if (length and last_length) {
+        const auto cos = (dx * m_last_dx + dy * m_last_dy) / (length * last_length);
+        const auto turn = std::acos(std::clamp(cos, -1.f, 1.f));
+        if (turn > 0.f)
+            speed = std::min(speed, std::sqrt(acceleration * length / turn));
+    }
+
+    m_travelled += length;
+    m_last_dx = dx;
+    m_last_dy = dy;
+
+    return Spout::flow_tag_for_scale(std::clamp(speed / m_average_speed, MIN_FLOW_SCALE, MAX_FLOW_SCALE));
+}
+
+f32 Trajectory::length_of(const Spiral& spiral) const {
+    f32 length = 0.f;
+    auto x = spiral.x_at(0.f);
+    auto y = spiral.y_at(0.f);
+    SpiralSegments segments{ spiral };
+    while (segments.next()) {
+        const auto dx = segments.x() - x;
+        const auto dy = (segments.y() - y) * m_y_scale;
+        length += std::sqrt(dx * dx + dy * dy);
+        x = segments.x();
+        y = segments.y();
+    }
+    return length;
+}
+}
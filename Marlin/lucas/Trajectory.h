@@ -0,0 +1,111 @@
+#pragma once
+
+#include <lucas/lucas.h>
+#include <src/MarlinCore.h>
+
+namespace lucas {
+// an archimedean spiral around the origin, whose radius changes linearly with the angle
+// a circle is simply a spiral that starts and ends with the same radius
+struct Spiral {
+    f32 start_radius = 0.f;
+    f32 end_radius = 0.f;
+    f32 turns = 1.f;
+    // in radians, 0 being the +X direction
+    f32 start_angle = 0.f;
+    bool clockwise = true;
+
+    f32 x_at(f32 t) const;
+    f32 y_at(f32 t) const;
+
+    f32 radius_at(f32 t) const { return start_radius + (end_radius - start_radius) * t; }
+};
+
+// the straight segments that approximate a spiral, generated one at a time so that nothing is allocated
+// each segment is as long as the curvature allows, which keeps the planner fed without wasting blocks on tiny moves
+class SpiralSegments {
+public:
+    explicit SpiralSegments(const Spiral& spiral)
+        : m_spiral(spiral) {
+    }
+
+    // advances to the end of the next segment, returns false once the spiral is over
+    bool next();
+
+    f32 x() const { return m_spiral.x_at(m_t); }
+    f32 y() const { return m_spiral.y_at(m_t); }
+
+    // how far a segment can stray from the real curve, in mm
+    static constexpr f32 CHORD_TOLERANCE = 0.05f;
+    static constexpr f32 MIN_SEGMENT_LENGTH = 0.5f;
+    static constexpr f32 MAX_SEGMENT_LENGTH = 4.f;
+
+private:
+    Spiral m_spiral;
+    f32 m_t = 0.f;
+};
+
+// feeds patterns straight into the planner, as offsets in mm from a center point
+// `current_position` always follows the last point sent, just like it does for regular gcode moves
+class Trajectory {
+public:
+    // `y_scale` stretches every offset along the y axis, see `MotionController::ANGLE_FIX`
+    Trajectory(const xyze_pos_t& center, f32 feedrate_mm_s, f32 y_scale = 1.f)
+        : m_center(center)
+        , m_feedrate(feedrate_mm_s)
+        , m_y_scale(y_scale) {
+    }
+
+    // the offset where the spout currently is, relative to the center
+    void start_at(f32 x, f32 y) {
+        m_x = x;
+        m_y = y;
+    }
+
+    // returns false if it was stopped before reaching the end of the spiral
+    bool follow(const Spiral& spiral, util::Fn<bool> auto&& should_stop) {
+        SpiralSegments segments{ spiral };
+        while (segments.next()) {
+            if (not line_to(segments.x(), segments.y()) or std::invoke(should_stop))
+                return false;
+        }
+        return true;
+    }
+
+    bool line_to(f32 x, f32 y);
+
+    // tags every block with the flow the spout should have while executing it, so that the water per unit of area stays the same
+    // the flow follows the speed the spout is expected to have on each segment, relative to the average speed of the whole path
+    void sync_flow(f32 path_length, f32 average_speed) {
+        m_path_length = path_length;
+        m_average_speed = average_speed;
+        m_travelled = 0.f;
+    }
+
+    // the length of the spiral as it's actually travelled, segments and y stretching included
+    f32 length_of(const Spiral&) const;
+
+    // the offset of the last point sent to the planner, which is where the spout ends up once it's done moving
+    f32 x() const { return m_x; }
+    f32 y() const { return m_y; }
+
+    static constexpr f32 MIN_FLOW_SCALE = 0.25f;
+    static constexpr f32 MAX_FLOW_SCALE = 2.f;
+
+private:
+    u16 flow_tag_for_segment(f32 dx, f32 dy);
+
+    xyze_pos_t m_center;
+    f32 m_feedrate = 0.f;
+    f32 m_y_scale = 1.f;
+
+    f32 m_x = 0.f;
+    f32 m_y = 0.f;
+
+    f32 m_path_length = 0.f;
+    f32 m_average_speed = 0.f;
+    f32 m_travelled = 0.f;
+    // the previous segment, in mm, whose direction decides how fast the junction with the next one can be
+    f32 m_last_dx = 0.f;
+    f32 m_last_dy = 0.f;
+};
+}
@@ -24,6 +24,16 @@ constexpr auto DEFAULT_OPTIONS = std::to_array<Option>({
     [MaintenanceMode] = { .id = 'K', .active = false},
 
     [ForceFlowAnalysis] = { .id = 'X', .active = false },
+
+    [OptimizeSchedule] = { .id = 'O', .active = false },
+    [AbsorbDelays] = { .id = 'A', .active = true },
+
+    [FlowSyncPour] = { .id = 'P', .active = false },
+    [ClosedLoopPour] = { .id = 'C', .active = true },
+    [FastFlowAnalysis] = { .id = 'R', .active = true },
+    [InterpolateFlowCurves] = { .id = 'I', .active = true },
+    [SavePourRecords] = { .id = 'Q', .active = false },
+    [BoilerFeedForward] = { .id = 'H', .active = true },
 });
 // clang-format on
 
@@ -56,6 +66,8 @@ void setup() {
         entry = storage::create_entry(s_storage_handle);
         entry->write_binary(s_options);
     } else {
+        // options that didn't exist when the entry was saved keep their default values
+        s_options = detail::DEFAULT_OPTIONS;
         entry->read_binary_into(s_options);
     }
 }
@@ -31,6 +31,16 @@ enum Options {
 
     ForceFlowAnalysis,
 
+    OptimizeSchedule,
+    AbsorbDelays,
+
+    FlowSyncPour,
+    ClosedLoopPour,
+    FastFlowAnalysis,
+    InterpolateFlowCurves,
+    SavePourRecords,
+    BoilerFeedForward,
+
     Count
 };
 
@@ -2,33 +2,44 @@
 #include <lucas/Spout.h>
 #include <lucas/RecipeQueue.h>
 #include <lucas/MotionController.h>
+#include <lucas/Trajectory.h>
+#include <lucas/util/StaticVector.h>
 #include <src/gcode/gcode.h>
 #include <src/gcode/parser.h>
 #include <src/module/planner.h>
+#include <numbers>
 
 #define L0_LOG(...) LOG_IF(LogLn, "", "L0: ", __VA_ARGS__);
 
 namespace lucas::cmd {
 void L0() {
+    L0({
+        .diameter = parser.floatval('D'),
+        .number_of_circles = parser.intval('N'),
+        .repetitions = parser.intval('R', 0),
+        .start_on_border = parser.seen_test('B'),
+        .duration = parser.ulongval('T'),
+        .volume_of_water = parser.floatval('G'),
+    });
+}
+
+void L0(const L0Params& params) {
     // o diametro é passado em cm, porem o marlin trabalho com mm
-    const auto total_diameter = (parser.floatval('D') / MotionController::the().step_ratio_x()) * 10.f;
+    const auto total_diameter = params.diameter * 10.f;
     if (total_diameter == 0.f)
         return;
 
     const auto radius = total_diameter / 2.f;
-    const auto number_of_circles = parser.intval('N');
+    const auto number_of_circles = params.number_of_circles;
     if (number_of_circles == 0)
         return;
 
-    // cada circulo é composto por 2 arcos
-    const auto number_of_arcs = number_of_circles * 2;
-    const auto offset_per_arc = radius / static_cast<float>(number_of_circles);
-    const auto repetitions = parser.intval('R', 0);
+    const auto repetitions = std::min(params.repetitions, L0Params::MAX_REPETITIONS);
     const auto series = repetitions + 1;
-    const auto start_on_border = parser.seen_test('B');
-    const auto duration = parser.ulongval('T');
+    const auto start_on_border = params.start_on_border;
+    const auto duration = params.duration;
 
-    L0_LOG("!opcoes!\ndiametro = ", total_diameter, "\nraio = ", radius, "\nnum_circulos = ", number_of_circles, "\nnum_arcos = ", number_of_arcs, "\noffset_por_arco = ", offset_per_arc, "\nrepeticoes = ", repetitions, "\nseries = ", series, "\ncomecar_na_borda = ", start_on_border, "\nduracao = ", duration);
+    L0_LOG("!opcoes!\ndiametro = ", total_diameter, "\nraio = ", radius, "\nnum_circulos = ", number_of_circles, "\nrepeticoes = ", repetitions, "\nseries = ", series, "\ncomecar_na_borda = ", start_on_border, "\nduracao = ", duration);
 
     if (CFG(GigaMode) and duration) {
         L0_LOG("iniciado no modo giga");
@@ -37,103 +48,56 @@ void L0() {
         return;
     }
 
-    const auto volume_of_water = parser.floatval('G');
+    const auto volume_of_water = params.volume_of_water;
     const auto should_pour = duration and volume_of_water;
 
     const bool associated_with_station = RecipeQueue::the().is_executing_recipe();
-    bool dip = false;
+    const auto cancelled = [associated_with_station] {
+        return associated_with_station and not RecipeQueue::the().is_executing_recipe();
+    };
 
     const auto initial_position = current_position;
     L0_LOG("initial_position.x: ", initial_position.x);
 
-    auto final_position = initial_position;
-
-    std::vector<float> diameters;
-    diameters.reserve(number_of_arcs * series);
-
+    // cada serie é uma espiral, alternando entre de fora pra dentro e de dentro pra fora
+    // a borda fica sempre em -X, que é onde as espirais de fora pra dentro começam e as de dentro pra fora terminam
+    util::StaticVector<Spiral, L0Params::MAX_REPETITIONS + 1> spirals;
     for (auto serie = 0; serie < series; serie++) {
         const bool out_to_in = serie % 2 != start_on_border;
-        for (auto arco = 0; arco < number_of_arcs; arco++) {
-            const auto arc_offset = offset_per_arc * arco;
-            float arc_diameter = out_to_in ? std::abs(arc_offset - total_diameter) : arc_offset + offset_per_arc;
-            if (arco % 2)
-                arc_diameter = -arc_diameter;
-
-            diameters.emplace_back(arc_diameter);
-        }
+        spirals.push_back({
+            .start_radius = out_to_in ? radius : 0.f,
+            .end_radius = out_to_in ? 0.f : radius,
+            .turns = f32(number_of_circles),
+            .start_angle = std::numbers::pi_v<f32>,
+        });
     }
 
-    char buffer_radius[16] = {};
-    dtostrf(radius, 0, 2, buffer_radius);
-
+    millis_t time_until_pattern = 0;
     if (start_on_border) {
-        execute_fmt("G0 F10000 X-%s", buffer_radius);
-        MotionController::the().finish_movements();
-    }
-
-    float total_to_move = 0.f;
-    for (const auto diameter : diameters)
-        total_to_move += (2.f * PI * std::abs(diameter / 2.f)) / 2.f;
-
-    const auto steps_por_mm_ratio = duration ? MotionController::MS_PER_MM / (duration / total_to_move) : 1.f;
-
-    soft_endstop._enabled = false;
-    MotionController::the().change_step_ratio(steps_por_mm_ratio,
-                                              steps_por_mm_ratio * MotionController::ANGLE_FIX);
-
-    if (should_pour) {
-        Spout::the().pour_with_desired_volume(duration, volume_of_water);
-
-        // wait for the water to actually start pouring
-        const auto flow = volume_of_water / (duration / 1000.f);
-        const auto norm = util::normalize(flow, Spout::FlowController::FLOW_MIN, Spout::FlowController::FLOW_MAX);
-        const auto lerp = chrono::duration<float, std::milli>(std::lerp(300.f, 100.f, norm));
-
-        util::idle_for(lerp);
-    }
-
-    for (const auto diameter : diameters) {
-        float radius = diameter / 2.f;
-
-        char buffer_diameter[16] = {};
-        dtostrf(diameter / steps_por_mm_ratio, 0, 2, buffer_diameter);
-
-        char buffer_radius[16] = {};
-        dtostrf(radius / steps_por_mm_ratio, 0, 2, buffer_radius);
-
-        execute_fmt("G2 F5000 X%s I%s", buffer_diameter, buffer_radius);
-
-        final_position.x += diameter;
-        if (associated_with_station and not RecipeQueue::the().is_executing_recipe()) {
-            L0_LOG("receita foi cancelada, abortando");
-            dip = true;
-            if (should_pour)
-                Spout::the().end_pour();
-            break;
-        }
+        MotionController::the().move_by(-radius, 0.f, MotionController::REPOSITION_FEEDRATE);
+        time_until_pattern = MotionController::the().move_time(radius, MotionController::REPOSITION_FEEDRATE);
     }
 
+    // the pump is started while the spout is still getting to the beginning of the pattern, so the water hits the coffee right as it begins
+    // when executed by the queue it's usually already on, since it was started during the travel to the station
+    if (should_pour)
+        Spout::the().pour_ahead_of_pattern(duration, volume_of_water, millis() + time_until_pattern);
     MotionController::the().finish_movements();
 
-    current_position = final_position;
-    L0_LOG("final_position.x = ", current_position.x);
-
-    soft_endstop._enabled = true;
-    MotionController::the().change_step_ratio(1.f);
-
-    if (dip) {
-        sync_plan_position();
+    if (not MotionController::the().follow_timed_path(spirals, duration, cancelled)) {
+        L0_LOG("receita foi cancelada, abortando");
+        if (should_pour)
+            Spout::the().end_pour();
         return;
     }
 
+    L0_LOG("final_position.x = ", current_position.x);
+
     if (series % 2 != start_on_border) {
-        execute_fmt("G0 F10000 X%s", buffer_radius);
+        MotionController::the().move_by(initial_position.x - current_position.x, initial_position.y - current_position.y, MotionController::REPOSITION_FEEDRATE);
         MotionController::the().finish_movements();
     }
 
-    current_position = initial_position;
-    sync_plan_position();
-
     if (should_pour)
         util::idle_while([] { return Spout::the().pouring(); });
 }
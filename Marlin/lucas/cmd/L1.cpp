@@ -2,25 +2,34 @@
 #include <lucas/Spout.h>
 #include <lucas/RecipeQueue.h>
 #include <lucas/MotionController.h>
+#include <lucas/Trajectory.h>
 #include <src/gcode/gcode.h>
 #include <src/gcode/parser.h>
 #include <src/module/planner.h>
+#include <numbers>
 
 namespace lucas::cmd {
 void L1() {
+    L1({
+        .diameter = parser.floatval('D'),
+        .number_of_repetitions = parser.intval('N'),
+        .duration = parser.ulongval('T'),
+        .volume_of_water = parser.floatval('G'),
+    });
+}
+
+void L1(const L1Params& params) {
     // o diametro é passado em cm, porem o marlin trabalho com mm
-    const auto circle_diameter = (parser.floatval('D') / MotionController::the().step_ratio_x()) * 10.f;
+    const auto circle_diameter = params.diameter * 10.f;
     if (circle_diameter == 0.f)
         return;
 
     const auto circle_radius = circle_diameter / 2.f;
-    const auto number_of_repetitions = parser.intval('N');
+    const auto number_of_repetitions = params.number_of_repetitions;
     if (number_of_repetitions == 0)
         return;
 
-    // cada circulo é composto por 2 arcos
-    const auto number_of_arcs = number_of_repetitions * 2;
-    const auto duration = parser.ulongval('T');
+    const auto duration = params.duration;
 
     if (CFG(GigaMode) and duration) {
         LOG_IF(LogLn, "iniciando L1 em modo giga");
@@ -29,78 +38,41 @@ void L1() {
         return;
     }
 
-    const auto volume_of_water = parser.floatval('G');
+    const auto volume_of_water = params.volume_of_water;
     const auto should_pour = duration and volume_of_water;
     const bool associated_with_station = RecipeQueue::the().is_executing_recipe();
-    bool dip = false;
+    const auto cancelled = [associated_with_station] {
+        return associated_with_station and not RecipeQueue::the().is_executing_recipe();
+    };
 
     const auto initial_position = current_position;
-    auto final_position = initial_position;
-
-    execute_ff("G0 F10000 X%s", -circle_radius);
-    MotionController::the().finish_movements();
-
-    const float total_to_move = (2.f * std::numbers::pi_v<float> * circle_radius) * number_of_repetitions;
-    const float steps_por_mm_ratio = duration ? MotionController::MS_PER_MM / (duration / total_to_move) : 1.f;
-
-    soft_endstop._enabled = false;
-    MotionController::the().change_step_ratio(steps_por_mm_ratio,
-                                              steps_por_mm_ratio * MotionController::ANGLE_FIX);
-
-    if (should_pour) {
-        Spout::the().pour_with_desired_volume(duration, volume_of_water);
-
-        // wait for the water to actually start pouring
-        const auto flow = volume_of_water / (duration / 1000.f);
-        const auto norm = util::normalize(flow, Spout::FlowController::FLOW_MIN, Spout::FlowController::FLOW_MAX);
-        const auto lerp = chrono::duration<float, std::milli>(std::lerp(300.f, 100.f, norm));
-
-        util::idle_for(lerp);
-    }
 
-    for (s32 i = 0; i < number_of_arcs; i++) {
-        float diameter = circle_diameter;
-        if (i % 2 != 0)
-            diameter = -diameter;
+    MotionController::the().move_by(-circle_radius, 0.f, MotionController::REPOSITION_FEEDRATE);
+    const auto time_until_pattern = MotionController::the().move_time(circle_radius, MotionController::REPOSITION_FEEDRATE);
 
-        float radius = diameter / 2.f;
-
-        final_position.x = initial_position.x + radius;
-
-        char buffer_diameter[16] = {};
-        dtostrf(diameter / steps_por_mm_ratio, 0, 2, buffer_diameter);
-
-        char buffer_radius[16] = {};
-        dtostrf(radius / steps_por_mm_ratio, 0, 2, buffer_radius);
-
-        execute_fmt("G2 F5000 X%s I%s", buffer_diameter, buffer_radius);
-
-        if (associated_with_station and not RecipeQueue::the().is_executing_recipe()) {
-            dip = true;
-            if (should_pour)
-                Spout::the().end_pour();
-            break;
-        }
-    }
+    // a circle is a spiral that never changes its radius, starting on the border at -X
+    const auto circle = Spiral{
+        .start_radius = circle_radius,
+        .end_radius = circle_radius,
+        .turns = f32(number_of_repetitions),
+        .start_angle = std::numbers::pi_v<float>,
+    };
 
+    // the pump is started while the spout is still getting to the beginning of the pattern, so the water hits the coffee right as it begins
+    // when executed by the queue it might already be on, since it was started during the travel to the station
+    if (should_pour)
+        Spout::the().pour_ahead_of_pattern(duration, volume_of_water, millis() + time_until_pattern);
     MotionController::the().finish_movements();
 
-    current_position = final_position;
-    soft_endstop._enabled = true;
-    MotionController::the().change_step_ratio(1.f);
-
-    if (dip) {
-        sync_plan_position();
+    if (not MotionController::the().follow_timed_path({ &circle, 1 }, duration, cancelled)) {
+        if (should_pour)
+            Spout::the().end_pour();
         return;
     }
 
-    const auto offset = initial_position.x - final_position.x;
-    execute_ff("G0 F10000 X%s", offset);
+    MotionController::the().move_by(initial_position.x - current_position.x, initial_position.y - current_position.y, MotionController::REPOSITION_FEEDRATE);
     MotionController::the().finish_movements();
 
-    current_position = initial_position;
-    sync_plan_position();
-
     if (should_pour)
         util::idle_while([] { return Spout::the().pouring(); });
 }
@@ -5,17 +5,28 @@
 
 namespace lucas::cmd {
 void L2() {
+    auto params = L2Params{
+        .duration = parser.ulongval('T'),
+        .volume_of_water = parser.floatval('G'),
+    };
+    if (parser.seenval('D'))
+        params.digital_signal = parser.ulongval('D');
+
+    L2(params);
+}
+
+void L2(const L2Params& params) {
     if (CFG(GigaMode)) {
         LOG_IF(LogLn, "iniciando L2 em modo giga");
-        util::idle_for(chrono::milliseconds{ parser.ulongval('T') });
+        util::idle_for(chrono::milliseconds{ params.duration });
         LOG_IF(LogLn, "L2 finalizado");
         return;
     }
 
-    if (parser.seenval('D'))
-        Spout::the().pour_with_digital_signal(parser.ulongval('T'), parser.ulongval('D'));
+    if (params.digital_signal)
+        Spout::the().pour_with_digital_signal(params.duration, *params.digital_signal);
     else
-        Spout::the().pour_with_desired_volume(parser.ulongval('T'), parser.floatval('G'));
+        Spout::the().pour_with_desired_volume(params.duration, params.volume_of_water);
 
     const bool associated_with_station = RecipeQueue::the().is_executing_recipe();
     util::idle_while([&] {
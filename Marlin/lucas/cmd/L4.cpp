@@ -4,6 +4,7 @@
 #include <lucas/Recipe.h>
 #include <lucas/cfg/cfg.h>
 #include <lucas/sec/sec.h>
+#include <lucas/info/info.h>
 #include <src/gcode/parser.h>
 
 namespace lucas::cmd {
@@ -31,6 +32,7 @@ void L4() {
         cfg::save_options();
 
     if (updated_maintenance_mode) {
+        info::flush_queued_events();
         SERIAL_IMPL.flush();
         noInterrupts();
         NVIC_SystemReset();
@@ -18,6 +18,14 @@ void L7() {
         Spout::FlowController::the().update_flow_hint_for_pulse_calculation(parser.value_float());
     }
 
+    // the real volume of the last pour, in ml
+    if (parser.seenval('V'))
+        Spout::the().inform_measured_volume_of_last_pour(parser.value_float());
+
+    // back to the constants above, whatever was learned is forgotten
+    if (parser.seen('U'))
+        Spout::FlowController::the().forget_pulse_weight();
+
     if (parser.seenval('E'))
         storage::purge_entry(parser.value_int());
 
@@ -1,9 +1,14 @@
 #include "cmd.h"
 #include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
 #include <src/gcode/parser.h>
 #include <src/gcode/queue.h>
 #include <src/gcode/gcode.h>
 #include <lucas/Station.h>
+#include <lucas/MotionController.h>
 #include <lucas/serial/Hook.h>
 
 namespace lucas::cmd {
@@ -16,6 +21,195 @@ void execute(const char* gcode) {
 void interpret_gcode_from_host(std::span<char> buffer) {
     GcodeSuite::process_subcommands_now(buffer.data());
 }
+
+namespace {
+// the parameters of a single command, indexed by their letter
+class StepTokens {
+public:
+    bool parse(const char* text) {
+        // strto* only hand back a mutable pointer, though they never write through it
+        char* gcode = const_cast<char*>(text);
+        while (*gcode == ' ')
+            ++gcode;
+
+        if (*gcode != 'L' or not std::isdigit(gcode[1]))
+            return false;
+
+        m_command = s32(std::min(strtol(gcode + 1, &gcode, 10), long(std::numeric_limits<s32>::max())));
+        for (;;) {
+            while (*gcode == ' ')
+                ++gcode;
+
+            if (*gcode == '\0')
+                return true;
+
+            const auto letter = *gcode++;
+            if (letter < 'A' or letter > 'Z')
+                return false;
+
+            auto& param = m_params[letter - 'A'];
+            param.seen = true;
+
+            // parameters without a value are flags, like `B` in L0
+            if (*gcode == ' ' or *gcode == '\0')
+                continue;
+
+            char* end = nullptr;
+            param.value = strtod(gcode, &end);
+            if (end == gcode or (*end != ' ' and *end != '\0'))
+                return false;
+
+            // strtod also takes `nan`, `inf` and huge exponents, every value has to fit in any of the types it's read as
+            if (not std::isfinite(param.value) or param.value < 0.0 or param.value > MAX_VALUE)
+                return false;
+
+            param.has_value = true;
+            gcode = end;
+        }
+    }
+
+    s32 command() const { return m_command; }
+
+    bool seen(char letter) const { return m_params[letter - 'A'].seen; }
+
+    bool has_value(char letter) const { return m_params[letter - 'A'].has_value; }
+
+    f32 float_value(char letter, f32 fallback = 0.f) const {
+        const auto& param = m_params[letter - 'A'];
+        return param.has_value ? f32(param.value) : fallback;
+    }
+
+    s32 int_value(char letter, s32 fallback = 0) const {
+        const auto& param = m_params[letter - 'A'];
+        return param.has_value ? s32(param.value) : fallback;
+    }
+
+    millis_t millis_value(char letter) const {
+        const auto& param = m_params[letter - 'A'];
+        return param.has_value ? millis_t(param.value) : 0;
+    }
+
+private:
+    static constexpr f64 MAX_VALUE = std::numeric_limits<s32>::max();
+
+    struct Param {
+        f64 value = 0.0;
+        bool seen = false;
+        bool has_value = false;
+    };
+
+    s32 m_command = -1;
+    std::array<Param, 'Z' - 'A' + 1> m_params = {};
+};
+}
+
+std::optional<CompiledStep> compile_step(const char* gcode) {
+    StepTokens tokens;
+    if (not gcode or not tokens.parse(gcode)) {
+        LOG_ERR("gcode do passo mal formatado - [", gcode ? gcode : "null", "]");
+        return std::nullopt;
+    }
+
+    const auto invalid = [gcode](const char* reason) -> std::optional<CompiledStep> {
+        LOG_ERR("gcode do passo invalido - [", gcode, " | ", reason, "]");
+        return std::nullopt;
+    };
+
+    switch (tokens.command()) {
+    case 0: {
+        const auto params = L0Params{
+            .diameter = tokens.float_value('D'),
+            .number_of_circles = tokens.int_value('N'),
+            .repetitions = tokens.int_value('R'),
+            .start_on_border = tokens.seen('B'),
+            .duration = tokens.millis_value('T'),
+            .volume_of_water = tokens.float_value('G'),
+        };
+        if (params.diameter == 0.f or params.number_of_circles == 0)
+            return invalid("diametro e numero de circulos sao obrigatorios");
+        if (params.volume_of_water != 0.f and params.duration == 0)
+            return invalid("volume requer tempo");
+        if (params.repetitions > L0Params::MAX_REPETITIONS)
+            return invalid("repeticoes demais");
+        return params;
+    }
+    case 1: {
+        const auto params = L1Params{
+            .diameter = tokens.float_value('D'),
+            .number_of_repetitions = tokens.int_value('N'),
+            .duration = tokens.millis_value('T'),
+            .volume_of_water = tokens.float_value('G'),
+        };
+        if (params.diameter == 0.f or params.number_of_repetitions == 0)
+            return invalid("diametro e numero de repeticoes sao obrigatorios");
+        if (params.volume_of_water != 0.f and params.duration == 0)
+            return invalid("volume requer tempo");
+        return params;
+    }
+    case 2: {
+        auto params = L2Params{
+            .duration = tokens.millis_value('T'),
+            .volume_of_water = tokens.float_value('G'),
+        };
+        if (tokens.has_value('D'))
+            params.digital_signal = u32(tokens.int_value('D'));
+        if (params.duration == 0)
+            return invalid("tempo e obrigatorio");
+        if (not params.digital_signal and params.volume_of_water == 0.f)
+            return invalid("volume ou sinal digital sao obrigatorios");
+        return params;
+    }
+    default:
+        return invalid("comando desconhecido");
+    }
+}
+
+void execute_step(const CompiledStep& step) {
+    std::visit(
+        [](const auto& params) {
+            using T = std::decay_t<decltype(params)>;
+            if constexpr (std::is_same_v<T, L0Params>)
+                L0(params);
+            else if constexpr (std::is_same_v<T, L1Params>)
+                L1(params);
+            else if constexpr (std::is_same_v<T, L2Params>)
+                L2(params);
+        },
+        step);
+}
+
+std::optional<PatternPour> pattern_pour_of_step(const CompiledStep& step) {
+    if (CFG(GigaMode))
+        return std::nullopt;
+
+    // the patterns always begin on the border, at -X, the reposition there being the only movement before it
+    const auto time_to_border = [](f32 diameter) {
+        // o diametro é passado em cm, porem o marlin trabalho com mm
+        return MotionController::the().move_time(diameter * 10.f / 2.f, MotionController::REPOSITION_FEEDRATE);
+    };
+
+    if (const auto l0 = std::get_if<L0Params>(&step)) {
+        if (not l0->duration or l0->volume_of_water == 0.f)
+            return std::nullopt;
+        return PatternPour{
+            .duration = l0->duration,
+            .volume_of_water = l0->volume_of_water,
+            .time_until_pattern = l0->start_on_border ? time_to_border(l0->diameter) : 0,
+        };
+    }
+
+    if (const auto l1 = std::get_if<L1Params>(&step)) {
+        if (not l1->duration or l1->volume_of_water == 0.f)
+            return std::nullopt;
+        return PatternPour{
+            .duration = l1->duration,
+            .volume_of_water = l1->volume_of_water,
+            .time_until_pattern = time_to_border(l1->diameter),
+        };
+    }
+
+    return std::nullopt;
+}
 }
 
 /* alguns comandos uteis
@@ -23,6 +217,7 @@ void interpret_gcode_from_host(std::span<char> buffer) {
 #{"cmdInitializeStations":[true, true, true, true, true]}#
 #{"cmdSetBoilerTemperature":94}#
 #{"cmdInitializeStations":[true, true, true, true, true],"cmdSetBoilerTemperature":94}#
+#{"cmdSetProtocol":"msgpack"}#
 
 ~ recipes ~
 #{"devScheduleStandardRecipe":1}#
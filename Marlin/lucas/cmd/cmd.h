@@ -1,6 +1,8 @@
 #pragma once
 
 #include <lucas/lucas.h>
+#include <optional>
+#include <variant>
 #include <span>
 
 namespace lucas::cmd {
@@ -27,17 +29,62 @@ void interpret_gcode_from_host(std::span<char> buffer);
 // [T] - Tempo aproximado, em milisegundos, que o movimento e despejo irão durar
 // [R] - Quantidade de vezes que o movimento deve ser repetido
 // [B] - Iniciar na borda
+struct L0Params {
+    static constexpr s32 MAX_REPETITIONS = 7;
+
+    f32 diameter = 0.f;
+    s32 number_of_circles = 0;
+    s32 repetitions = 0;
+    bool start_on_border = false;
+    millis_t duration = 0;
+    f32 volume_of_water = 0.f;
+};
 void L0();
+void L0(const L0Params&);
 // L1 -> Círculo
 // D - Diâmetro máximo do circulo gerado
 // N - Número de repetições
 // [G] - Volume de água a ser despejado durante a espiral (requer o parâmetro T)
 // [T] - Tempo aproximado, em milisegundos, que o movimento e despejo irão durar
+struct L1Params {
+    f32 diameter = 0.f;
+    s32 number_of_repetitions = 0;
+    millis_t duration = 0;
+    f32 volume_of_water = 0.f;
+};
 void L1();
+void L1(const L1Params&);
 // L2 -> Despejo de água
 // G - Volume total de água a ser despejado
 // T - Tempo, em milisegundos, que o bico deve ficar ligado
+// [D] - Sinal digital fixo, ignorando o volume
+struct L2Params {
+    millis_t duration = 0;
+    f32 volume_of_water = 0.f;
+    std::optional<u32> digital_signal = std::nullopt;
+};
 void L2();
+void L2(const L2Params&);
+
+// the gcode of a recipe step, already parsed and validated
+using CompiledStep = std::variant<L0Params, L1Params, L2Params>;
+
+// parses a single L0/L1/L2 command without touching marlin's global parser
+// returns nothing if the command is unknown or any of its parameters is invalid
+std::optional<CompiledStep> compile_step(const char* gcode);
+
+void execute_step(const CompiledStep&);
+
+// the pour of a step that follows a pattern, `time_until_pattern` being how long the spout takes to get to its beginning once the step starts
+struct PatternPour {
+    millis_t duration = 0;
+    f32 volume_of_water = 0.f;
+    millis_t time_until_pattern = 0;
+};
+
+// nothing if the step doesn't pour while following a pattern
+std::optional<PatternPour> pattern_pour_of_step(const CompiledStep&);
+
 /* ~comandos de desenvolvimento~ */
 void L3();
 void L4();
@@ -7,6 +7,7 @@
 #include <lucas/Station.h>
 #include <lucas/MotionController.h>
 #include <lucas/RecipeQueue.h>
+#include <lucas/PourLog.h>
 #include <lucas/info/info.h>
 #include <lucas/serial/serial.h>
 
@@ -21,8 +22,12 @@ static util::Timer s_time_since_setup = {};
 static f32 s_startup_temperature = 0.f;
 static std::optional<s32> s_last_session_target_temperature = std::nullopt;
 
+static void setup_firmware_update();
+
 void setup() {
     MotionController::the().setup();
+    // updates are also received in maintenance mode
+    setup_firmware_update();
 
     if (CFG(MaintenanceMode)) {
         Boiler::the().setup();
@@ -33,6 +38,7 @@ void setup() {
 
     Boiler::the().setup();
     Spout::the().setup();
+    PourLog::the().setup();
     RecipeQueue::the().setup();
     Station::setup();
 
@@ -55,6 +61,9 @@ void tick() {
     if (not is_filtered(Filter::Boiler))
         Boiler::the().tick();
 
+    // motion
+    MotionController::the().tick();
+
     // queue
     if (not is_filtered(Filter::RecipeQueue))
         RecipeQueue::the().tick();
@@ -68,6 +77,7 @@ void tick() {
     Station::update_leds();
 
     // spout
+    FlowSensor::the().tick();
     if (not is_filtered(Filter::Spout))
         Spout::the().tick();
 
@@ -85,6 +95,20 @@ void tick() {
     }
 }
 
+// if we have a scheduled calibration we execute it now
+// like i said, the flow of the code gets really nasty.
+static bool run_scheduled_calibration() {
+    if (not s_scheduled_calibration_temperature)
+        return false;
+
+    LOG_IF(LogCalibration, "executando calibracao agendada");
+
+    s_calibration_phase = CalibrationPhase::None;
+    Spout::FlowController::the().set_abort_analysis(false);
+    calibrate(std::exchange(s_scheduled_calibration_temperature, std::nullopt));
+    return true;
+}
+
 void calibrate(std::optional<s32> target_temperature) {
     if (target_temperature == Boiler::the().target_temperature())
         return;
@@ -100,6 +124,12 @@ void calibrate(std::optional<s32> target_temperature) {
         LOG_IF(LogCalibration, "trocando temperatura target");
         boiler.update_target_temperature(target_temperature);
         return;
+    // the relay is stopped and the new temperature is calibrated right after, in the same way as the flow analysis below
+    case CalibrationPhase::TuningBoiler:
+        LOG_IF(LogCalibration, "cancelando autotune do boiler");
+        boiler.abort_autotune();
+        s_scheduled_calibration_temperature = target_temperature;
+        return;
     // if we're doing flow analysis it gets a bit more complex
     // we tell the flow controller it should abort, wait for it's loop to be called again and save the new desired temperature for later
     // "later" in this case is a few lines below, where `s_scheduled_calibration_temperature` is used.
@@ -115,6 +145,9 @@ void calibrate(std::optional<s32> target_temperature) {
 
     LOG_IF(LogCalibration, "iniciando nivelamento");
 
+    // only the pairs of locations that were never measured are travelled here, the rest is kept up to date by every travel
+    MotionController::the().calibrate_travel_times();
+
     {
         info::TemporaryCommandHook hook{ info::Command::RequestInfoCalibration, &Boiler::inform_temperature_status };
         s_calibration_phase = CalibrationPhase::ReachingTargetTemperature;
@@ -122,13 +155,21 @@ void calibrate(std::optional<s32> target_temperature) {
         boiler.update_and_reach_target_temperature(target_temperature);
     }
 
-    const auto restarted_not_long_ago = s_startup_temperature >= 60.f; // water is still warm
-    const auto same_target_as_last_analysis = flow_controller.last_analysis_target_temperature() == boiler.target_temperature();
+    if (not CFG(GigaMode) and boiler.target_temperature() and boiler.needs_autotune()) {
+        info::TemporaryCommandHook hook{ info::Command::RequestInfoCalibration, &Boiler::inform_autotune_status };
+        s_calibration_phase = CalibrationPhase::TuningBoiler;
 
-    const auto should_reuse_flow_analysis_data = restarted_not_long_ago and same_target_as_last_analysis;
-    if (should_reuse_flow_analysis_data and not CFG(ForceFlowAnalysis)) {
+        boiler.autotune();
+
+        if (run_scheduled_calibration())
+            return;
+    }
+
+    // the analyses made since the machine was turned on are always reused, the older ones only while the water is still warm
+    const auto restarted_not_long_ago = s_startup_temperature >= 60.f;
+
+    if (not CFG(ForceFlowAnalysis) and flow_controller.load_flow_curve_for(boiler.target_temperature(), restarted_not_long_ago)) {
         LOG_IF(LogCalibration, "reutilizando dados de analise de fluxo");
-        flow_controller.fetch_digital_signal_table_from_file();
 
         // force the flow controller to inform the host that analysis is finished
         flow_controller.update_status(Spout::FlowController::FlowAnalysisStatus::Done);
@@ -139,16 +180,8 @@ void calibrate(std::optional<s32> target_temperature) {
         flow_controller.analyse_and_store_flow_data();
     }
 
-    // if we have a scheduled calibration we execute it now
-    // like i said, the flow of the code gets really nasty.
-    if (s_scheduled_calibration_temperature) {
-        LOG_IF(LogCalibration, "executando calibracao agendada");
-
-        s_calibration_phase = CalibrationPhase::None;
-        flow_controller.set_abort_analysis(false);
-        calibrate(std::exchange(s_scheduled_calibration_temperature, std::nullopt));
+    if (run_scheduled_calibration())
         return;
-    }
 
     s_calibration_phase = CalibrationPhase::Done;
     tone(BEEPER_PIN, 7000, 1000);
@@ -159,6 +192,26 @@ CalibrationPhase calibration_phase() {
     return s_calibration_phase;
 }
 
+void tune_boiler() {
+    auto& boiler = Boiler::the();
+    boiler.request_autotune();
+
+    if (s_calibration_phase != CalibrationPhase::Done or not RecipeQueue::the().is_empty()) {
+        LOG_IF(LogCalibration, "autotune do boiler agendado para a proxima calibracao");
+        return;
+    }
+
+    info::TemporaryCommandHook hook{ info::Command::RequestInfoCalibration, &Boiler::inform_autotune_status };
+    s_calibration_phase = CalibrationPhase::TuningBoiler;
+
+    boiler.autotune();
+
+    if (run_scheduled_calibration())
+        return;
+
+    s_calibration_phase = CalibrationPhase::Done;
+}
+
 void inform_calibration_status() {
     info::send(
         info::Event::Calibration,
@@ -167,63 +220,225 @@ void inform_calibration_status() {
         });
 }
 
-static usize s_new_firmware_size = 0;
-static usize s_total_bytes_written = 0;
-
+// the bootloader flashes whatever is under this name when the board starts, so the image only gets it once it's whole and checked
 constexpr auto FIRMWARE_FILENAME = "Robin_nano_V3.bin";
+// where the image is received, and what a resumed update goes on writing
+constexpr auto PARTIAL_FIRMWARE_FILENAME = "Robin_nano_V3.part";
 static std::optional<storage::sd::File> s_firmware_file;
 
+// how far a verified update got, so one that's cut halfway can pick up from the last checkpoint instead of starting over
+struct StoredUpdateProgress {
+    u16 version = 0;
+    usize size = 0;
+    u32 image_crc = 0;
+    // everything before this is synced to the file
+    usize bytes_written = 0;
+    u32 running_crc = 0;
+};
+
+static constexpr u16 UPDATE_PROGRESS_STORAGE_VERSION = 1;
+
+// the file is synced and the progress saved every this many bytes, syncing every write would make the card the bottleneck again
+static constexpr usize UPDATE_CHECKPOINT_INTERVAL = 32 * 1024;
+
+static constexpr auto UPDATE_PROGRESS_INTERVAL = 500ms;
+
+static storage::Handle s_update_progress_storage_handle;
+
+static FirmwareUpdate s_update = {};
+static usize s_total_bytes_written = 0;
+static u32 s_running_crc = 0;
+static usize s_last_checkpoint = 0;
+static util::Timer s_update_progress_timer = {};
+
 static void reset() {
+    info::flush_queued_events();
     SERIAL_IMPL.flush();
     noInterrupts();
     NVIC_SystemReset();
 }
 
-static void firmware_update_failed(int error_code) {
-    s_new_firmware_size = 0;
-    s_total_bytes_written = 0;
-
+static void send_update_progress() {
+    s_update_progress_timer.restart();
     info::send(
         info::Event::Firmware,
-        [error_code](JsonObject o) {
-            o["updateFailedCode"] = error_code;
+        [](JsonObject o) {
+            o["updateProgress"] = util::normalize(s_total_bytes_written, 0, s_update.size);
         });
+}
 
-    storage::sd::Card::the().delete_file(FIRMWARE_FILENAME);
-    serial::FirmwareUpdateHook::the().deactivate();
+static void save_update_progress() {
+    s_last_checkpoint = s_total_bytes_written;
+    auto entry = storage::fetch_or_create_entry(s_update_progress_storage_handle);
+    entry.write_binary(StoredUpdateProgress{
+        .version = UPDATE_PROGRESS_STORAGE_VERSION,
+        .size = s_update.size,
+        .image_crc = *s_update.crc,
+        .bytes_written = s_total_bytes_written,
+        .running_crc = s_running_crc,
+    });
 }
 
-static void add_buffer_to_new_firmware_file(std::span<char> buffer) {
-    if (not s_firmware_file->write_binary(buffer)) {
-        firmware_update_failed(0);
-        return;
-    }
+static void firmware_update_failed(serial::FirmwareUpdateHook::ErrorCode error_code) {
+    // a verified update that stopped receiving can be resumed, everything up to the last checkpoint is kept
+    const auto resumable = s_update.crc and error_code == serial::FirmwareUpdateHook::Timeout and s_last_checkpoint;
 
-    s_total_bytes_written += buffer.size();
     info::send(
         info::Event::Firmware,
-        [](JsonObject o) {
-            o["updateProgress"] = util::normalize(s_total_bytes_written, 0, s_new_firmware_size);
+        [error_code, resumable](JsonObject o) {
+            o["updateFailedCode"] = int(error_code);
+            if (resumable)
+                o["updateResumable"] = s_last_checkpoint;
         });
 
-    // we're done
-    if (s_total_bytes_written == s_new_firmware_size) {
-        if (not CFG(MaintenanceMode))
-            Spout::FlowController::the().firmware_upgrade_finished();
+    if (not resumable) {
+        storage::sd::Card::the().delete_file(PARTIAL_FIRMWARE_FILENAME);
+        storage::purge_entry(s_update_progress_storage_handle);
+    }
+
+    s_update = {};
+    s_total_bytes_written = 0;
+    s_running_crc = 0;
+    s_last_checkpoint = 0;
+    serial::FirmwareUpdateHook::the().deactivate();
+}
+
+// the whole file is read back before the reset, what's checked is what's on the card and not what was in memory
+static bool is_written_image_valid() {
+    if (not s_firmware_file->sync() or not s_firmware_file->seek(0))
+        return false;
+
+    std::array<u8, serial::FirmwareUpdateHook::BLOCK_SIZE> block;
+    u32 crc = 0;
+    for (usize offset = 0; offset < s_update.size; offset += block.size()) {
+        const auto span = std::span{ block }.first(std::min(block.size(), s_update.size - offset));
+        if (not s_firmware_file->read_binary_into(span))
+            return false;
+        crc = util::crc32(span, crc);
+    }
+
+    LOG("crc do firmware novo - [esperado = ", *s_update.crc, " | escrito = ", crc, "]");
+    return crc == *s_update.crc;
+}
+
+static bool write_to_new_firmware_file(std::span<const char> buffer) {
+    return s_firmware_file->write_binary(buffer);
+}
+
+static void new_firmware_chunk_written(std::span<const char> chunk) {
+    s_total_bytes_written += chunk.size();
+    if (s_update.crc)
+        s_running_crc = util::crc32({ reinterpret_cast<const u8*>(chunk.data()), chunk.size() }, s_running_crc);
+
+    if (s_total_bytes_written < s_update.size) {
+        if (s_update.crc and s_total_bytes_written - s_last_checkpoint >= UPDATE_CHECKPOINT_INTERVAL) {
+            if (not s_firmware_file->sync()) {
+                firmware_update_failed(serial::FirmwareUpdateHook::WriteFailed);
+                return;
+            }
+            save_update_progress();
+        }
+
+        if (s_update_progress_timer >= UPDATE_PROGRESS_INTERVAL)
+            send_update_progress();
+        return;
+    }
+
+    // we're done, the 100% only goes out once the image checks out
+    if (s_update.crc) {
+        if (s_running_crc != *s_update.crc or not is_written_image_valid()) {
+            LOG_ERR("firmware novo nao bate com o crc enviado");
+            firmware_update_failed(serial::FirmwareUpdateHook::ImageMismatch);
+            return;
+        }
+        storage::purge_entry(s_update_progress_storage_handle);
+    } else if (not s_firmware_file->sync()) {
+        firmware_update_failed(serial::FirmwareUpdateHook::WriteFailed);
+        return;
+    }
 
-        reset();
+    if (not storage::sd::Card::the().rename_file(*s_firmware_file, FIRMWARE_FILENAME)) {
+        LOG_ERR("falha ao renomear o firmware novo");
+        firmware_update_failed(serial::FirmwareUpdateHook::WriteFailed);
+        return;
     }
+
+    send_update_progress();
+
+    if (not CFG(MaintenanceMode))
+        Spout::FlowController::the().firmware_upgrade_finished();
+
+    reset();
+}
+
+static void setup_firmware_update() {
+    s_update_progress_storage_handle = storage::register_handle_for_entry("fwupdate", sizeof(StoredUpdateProgress));
 }
 
-void prepare_for_firmware_update(usize size) {
-    s_new_firmware_size = size;
-    s_firmware_file = storage::sd::Card::the().open_file(FIRMWARE_FILENAME, O_WRITE | O_CREAT | O_TRUNC | O_SYNC);
+void prepare_for_firmware_update(const FirmwareUpdate& update) {
+    if (update.size == 0 or (update.resume and not update.crc)) {
+        LOG_ERR("atualizacao de firmware invalida - [tamanho = ", update.size, "]");
+        return;
+    }
+
+    s_update = update;
+    s_total_bytes_written = 0;
+    s_running_crc = 0;
+    s_last_checkpoint = 0;
+
+    // only a checkpoint of this exact image is resumed, anything else starts from scratch
+    std::optional<StoredUpdateProgress> progress;
+    if (update.resume) {
+        if (auto entry = storage::fetch_entry(s_update_progress_storage_handle)) {
+            const auto stored = entry->read_binary<StoredUpdateProgress>();
+            if (stored.version == UPDATE_PROGRESS_STORAGE_VERSION and stored.size == update.size and stored.image_crc == *update.crc and stored.bytes_written < update.size)
+                progress = stored;
+        }
+    }
+
+    s_firmware_file = storage::sd::Card::the().open_file(PARTIAL_FIRMWARE_FILENAME, O_RDWR | O_CREAT | (progress ? 0 : O_TRUNC));
     if (not s_firmware_file) {
-        firmware_update_failed(0);
+        firmware_update_failed(serial::FirmwareUpdateHook::WriteFailed);
         return;
     }
 
-    serial::FirmwareUpdateHook::the().activate(&add_buffer_to_new_firmware_file, &firmware_update_failed, s_new_firmware_size);
+    if (progress) {
+        // whatever was written after the checkpoint may not have made it to the card whole
+        if (s_firmware_file->file_size() < progress->bytes_written) {
+            progress = std::nullopt;
+            s_firmware_file->truncate(0);
+        } else {
+            s_firmware_file->truncate(progress->bytes_written);
+            s_total_bytes_written = s_last_checkpoint = progress->bytes_written;
+            s_running_crc = progress->running_crc;
+        }
+
+        if (not s_firmware_file->seek(s_total_bytes_written)) {
+            firmware_update_failed(serial::FirmwareUpdateHook::WriteFailed);
+            return;
+        }
+    }
+
+    if (not progress and update.crc)
+        save_update_progress();
+
+    LOG("recebendo firmware novo - [tamanho = ", update.size, " | a partir de = ", s_total_bytes_written, "]");
+    info::send(
+        info::Event::Firmware,
+        [](JsonObject o) {
+            o["updateOffset"] = s_total_bytes_written;
+        });
+
+    s_update_progress_timer.restart();
+    serial::FirmwareUpdateHook::the().activate(
+        {
+            .write = &write_to_new_firmware_file,
+            .chunk_written = &new_firmware_chunk_written,
+            .on_error = &firmware_update_failed,
+        },
+        update.size,
+        s_total_bytes_written,
+        update.crc.has_value());
     // TODO: purge all storage entries
 }
 }
@@ -13,13 +13,25 @@ void calibrate(std::optional<s32> target_temperature);
 enum class CalibrationPhase {
     None,
     ReachingTargetTemperature,
+    TuningBoiler,
     AnalysingFlowData,
     Done
 };
 
 CalibrationPhase calibration_phase();
 
+// tunes the boiler right away if the machine is calibrated and idle, otherwise it's done in the next calibration
+void tune_boiler();
+
 void inform_calibration_status();
 
-void prepare_for_firmware_update(usize size);
+struct FirmwareUpdate {
+    usize size = 0;
+    // of the whole image, without it the chunks carry no crc either and nothing is verified, like the updates of older hosts
+    std::optional<u32> crc = std::nullopt;
+    // picks up from the last checkpoint of an update of this same image, if there's one
+    bool resume = false;
+};
+
+void prepare_for_firmware_update(const FirmwareUpdate&);
 }
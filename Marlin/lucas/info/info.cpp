@@ -3,13 +3,19 @@
 #include <lucas/Station.h>
 #include <lucas/RecipeQueue.h>
 #include <lucas/Spout.h>
+#include <lucas/PourLog.h>
 #include <lucas/Boiler.h>
 #include <lucas/core/core.h>
 #include <lucas/cmd/cmd.h>
 #include <lucas/sec/sec.h>
 #include <lucas/serial/serial.h>
+#include <lucas/serial/FrameHook.h>
+#include <lucas/serial/CreditWindow.h>
+#include <lucas/util/StaticVector.h>
 
 namespace lucas::info {
+static void drain_queued_events();
+
 void tick() {
     if (CFG(LogTemperatureForTesting)) {
         every(1s) {
@@ -20,7 +26,9 @@ void tick() {
     every(1s) {
         static u32 s_stored_pulse_counter_for_logging = 0;
         if (CFG(LogFlowSensorDataForTesting) and s_stored_pulse_counter_for_logging != Spout::s_pulse_counter) {
-            LOG("SENSOR_FLUXO: ", Spout::s_pulse_counter, " - ", Spout::s_pulse_counter - s_stored_pulse_counter_for_logging);
+            auto& sensor = FlowSensor::the();
+            LOG("SENSOR_FLUXO: ", Spout::s_pulse_counter, " - ", Spout::s_pulse_counter - s_stored_pulse_counter_for_logging,
+                " - [frequencia = ", sensor.mean_frequency(1'000'000), "Hz | jitter = ", sensor.jitter(1'000'000), "us | perdidos = ", sensor.overruns(), "]");
             s_stored_pulse_counter_for_logging = Spout::s_pulse_counter;
         }
     }
@@ -44,7 +52,9 @@ void tick() {
     });
 
     if (updated)
-        print_json(doc);
+        print(doc);
+
+    drain_queued_events();
 }
 
 // https://www.notion.so/Comandos-enviados-do-app-para-a-m-quina-683dd32fcf93481bbe72d6ca276e7bfb?pvs=4
@@ -59,8 +69,17 @@ static Command command_from_string(std::string_view cmd) {
         [usize(Command::FirmwareUpdate)] = "cmdFirmwareUpdate"sv,
         [usize(Command::RequestInfoFirmware)] = "reqInfoFirmware"sv,
         [usize(Command::SetFixedRecipes)] = "cmdSetFixedRecipes"sv,
+        [usize(Command::RequestPourRecords)] = "reqPourRecords"sv,
+        [usize(Command::TuneBoiler)] = "cmdTuneBoiler"sv,
+        [usize(Command::SetProtocol)] = "cmdSetProtocol"sv,
+        [usize(Command::SetFlowControl)] = "cmdSetFlowControl"sv,
         [usize(Command::DevScheduleStandardRecipe)] = "devScheduleStandardRecipe"sv,
         [usize(Command::DevSimulateButtonPress)] = "devSimulateButtonPress"sv,
+        [usize(Command::DevRequestDispatchStats)] = "devReqDispatchStats"sv,
+        [usize(Command::DevSetFlowLoopGains)] = "devSetFlowLoopGains"sv,
+        [usize(Command::DevInformPouredVolume)] = "devInformPouredVolume"sv,
+        [usize(Command::DevSetPourMismatchThresholds)] = "devSetPourMismatchThresholds"sv,
+        [usize(Command::DevRequestSerialStats)] = "devReqSerialStats"sv,
     });
 
     auto it = std::find(map.begin(), map.end(), cmd);
@@ -87,6 +106,18 @@ info::TemporaryCommandHook::~TemporaryCommandHook() {
     install_command_hook(m_command, m_old_hook);
 }
 
+static auto s_protocol = Protocol::Json;
+
+Protocol protocol() {
+    return s_protocol;
+}
+
+void set_protocol(Protocol protocol) {
+    s_protocol = protocol;
+}
+
+static void interpret_commands(JsonObjectConst root);
+
 void interpret_command_from_host(std::span<char> buffer) {
     JsonDocument doc;
     const auto err = deserializeJson(doc, buffer.data(), buffer.size());
@@ -95,7 +126,21 @@ void interpret_command_from_host(std::span<char> buffer) {
         return;
     }
 
-    const auto root = doc.as<JsonObjectConst>();
+    interpret_commands(doc.as<JsonObjectConst>());
+}
+
+void interpret_frame_from_host(std::span<char> buffer) {
+    JsonDocument doc;
+    const auto err = deserializeMsgPack(doc, buffer.data(), buffer.size());
+    if (err) {
+        LOG_ERR("desserializacao messagepack falhou - [", err.c_str(), "]");
+        return;
+    }
+
+    interpret_commands(doc.as<JsonObjectConst>());
+}
+
+static void interpret_commands(JsonObjectConst root) {
     for (const auto obj : root) {
         if (obj.key().isNull() or obj.key().size() == 0) {
             LOG_ERR("chave invalida");
@@ -178,11 +223,22 @@ void interpret_command_from_host(std::span<char> buffer) {
             RecipeQueue::the().send_queue_info(stations);
         } break;
         case Command::FirmwareUpdate: {
-            if (not v.is<usize>()) {
+            // just the size for the updates that aren't verified, {"size": ..., "crc": ..., "resume": ...} for the ones that are
+            if (v.is<usize>()) {
+                core::prepare_for_firmware_update({ .size = v.as<usize>() });
+                break;
+            }
+
+            const auto obj = v.as<JsonObjectConst>();
+            if (obj.isNull() or not obj["size"].is<usize>() or not obj["crc"].is<u32>()) {
                 LOG_ERR("valor json invalido para tamanho do firmware novo");
                 break;
             }
-            core::prepare_for_firmware_update(v.as<usize>());
+            core::prepare_for_firmware_update({
+                .size = obj["size"].as<usize>(),
+                .crc = obj["crc"].as<u32>(),
+                .resume = obj["resume"].is<bool>() and obj["resume"].as<bool>(),
+            });
         } break;
         case Command::RequestInfoFirmware: {
             info::send(
@@ -199,6 +255,51 @@ void interpret_command_from_host(std::span<char> buffer) {
 
             RecipeQueue::the().set_fixed_recipes(v.as<JsonObjectConst>());
         } break;
+        case Command::RequestPourRecords: {
+            // the newest `n` records, or every one of them without a number
+            PourLog::the().send_records(v.is<usize>() ? v.as<usize>() : 0);
+        } break;
+        case Command::TuneBoiler: {
+            core::tune_boiler();
+        } break;
+        case Command::SetProtocol: {
+            if (not v.is<const char*>()) {
+                LOG_ERR("valor json invalido para protocolo");
+                break;
+            }
+
+            const auto name = std::string_view{ v.as<const char*>() };
+            if (name != "json"sv and name != "msgpack"sv) {
+                LOG_ERR("protocolo desconhecido - [", v.as<const char*>(), "]");
+                break;
+            }
+
+            // the answer still goes with the old protocol, every message after it with the new one
+            const auto new_protocol = name == "msgpack"sv ? Protocol::MessagePack : Protocol::Json;
+            send(
+                Event::Other,
+                [new_protocol](JsonObject o) {
+                    o["protocol"] = new_protocol == Protocol::MessagePack ? "msgpack" : "json";
+                });
+            set_protocol(new_protocol);
+        } break;
+        case Command::SetFlowControl: {
+            if (not v.is<const char*>()) {
+                LOG_ERR("valor json invalido para controle de fluxo");
+                break;
+            }
+
+            // the bytes are counted from the one right after this message, which is why it's enabled right here and not in the next tick
+            const auto name = std::string_view{ v.as<const char*>() };
+            if (name == "credit"sv) {
+                serial::CreditWindow::the().enable();
+            } else if (name == "ack"sv) {
+                serial::CreditWindow::the().disable();
+                LOG_IF(LogSerial, "controle de fluxo por okToReceive ativado");
+            } else {
+                LOG_ERR("controle de fluxo desconhecido - [", v.as<const char*>(), "]");
+            }
+        } break;
         /* ~comandos de desenvolvimento~ */
         case Command::DevScheduleStandardRecipe: {
             if (not v.is<usize>()) {
@@ -232,14 +333,150 @@ void interpret_command_from_host(std::span<char> buffer) {
                     simulate_button_press(index);
                 }
             }
+        } break;
+        case Command::DevRequestDispatchStats: {
+            // `true` also resets the stats after sending them
+            RecipeQueue::the().send_dispatch_stats(v.is<bool>() and v.as<bool>());
+        } break;
+        case Command::DevSetFlowLoopGains: {
+            if (not v.is<JsonObjectConst>()) {
+                LOG_ERR("valor json invalido para ganhos do controle de fluxo");
+                break;
+            }
+
+            // the gains that aren't sent stay the same
+            const auto obj = v.as<JsonObjectConst>();
+            auto& flow_loop = Spout::the().flow_loop();
+            auto gains = flow_loop.gains();
+            if (obj["kp"].is<f32>())
+                gains.kp = obj["kp"].as<f32>();
+            if (obj["ki"].is<f32>())
+                gains.ki = obj["ki"].as<f32>();
+            if (obj["kd"].is<f32>())
+                gains.kd = obj["kd"].as<f32>();
+            flow_loop.set_gains(gains);
+            LOG_IF(LogPour, "ganhos do controle de fluxo atualizados - [kp = ", gains.kp, " | ki = ", gains.ki, " | kd = ", gains.kd, "]");
+        } break;
+        case Command::DevInformPouredVolume: {
+            if (not v.is<f32>()) {
+                LOG_ERR("valor json invalido para volume medido");
+                break;
+            }
+
+            Spout::the().inform_measured_volume_of_last_pour(v.as<f32>());
+        } break;
+        case Command::DevSetPourMismatchThresholds: {
+            if (not v.is<JsonObjectConst>()) {
+                LOG_ERR("valor json invalido para limites de volume dos despejos");
+                break;
+            }
+
+            // the thresholds that aren't sent stay the same
+            const auto obj = v.as<JsonObjectConst>();
+            auto thresholds = PourLog::the().thresholds();
+            if (obj["relative"].is<f32>())
+                thresholds.relative = obj["relative"].as<f32>();
+            if (obj["absolute"].is<f32>())
+                thresholds.absolute = obj["absolute"].as<f32>();
+            if (obj["consecutive"].is<u8>())
+                thresholds.consecutive = std::max<u8>(obj["consecutive"].as<u8>(), 1);
+            PourLog::the().set_thresholds(thresholds);
+            LOG_IF(LogPour, "limites de volume dos despejos atualizados - [relativo = ", thresholds.relative, " | absoluto = ", thresholds.absolute, " | seguidos = ", thresholds.consecutive, "]");
+        } break;
+        case Command::DevRequestSerialStats: {
+            // `true` also resets the stats after sending them
+            serial::send_output_stats(v.is<bool>() and v.as<bool>());
+        } break;
         }
+    }
+}
+
+usize print(JsonDocument& doc) {
+    serial::HighPriorityOutput high_priority;
+    serial::CreditWindow::the().piggyback(doc);
+
+    if (s_protocol == Protocol::MessagePack) {
+        static u8 s_payload[serial::Hook::MAX_BUFFER_SIZE] = {};
+        const auto size = serializeMsgPack(doc, s_payload, sizeof(s_payload));
+        // a document that doesn't fit in a frame still gets to the host, just as json
+        if (size and size < sizeof(s_payload)) {
+            serial::FrameHook::send({ s_payload, size });
+            return size + serial::FrameHook::OVERHEAD;
         }
     }
+
+    return print_json(doc);
 }
 
-void print_json(const JsonDocument& doc) {
+usize print_json(const JsonDocument& doc) {
     SERIAL_CHAR('#');
-    serializeJson(doc, SERIAL_IMPL);
+    const auto size = serializeJson(doc, SERIAL_IMPL);
     SERIAL_ECHOLNPGM("#");
+    return size + 3;
+}
+
+static util::StaticVector<QueuedEvent, 16> s_queued_events;
+static u32 s_next_sequence = 0;
+
+static auto next_queued_event() {
+    return std::min_element(s_queued_events.begin(), s_queued_events.end(), [](const QueuedEvent& a, const QueuedEvent& b) {
+        return a.priority != b.priority ? a.priority > b.priority : a.sequence < b.sequence;
+    });
+}
+
+static usize write_next_queued_event() {
+    const auto it = next_queued_event();
+    // the event is taken out before it's built, in case building it posts another one
+    const auto event = *it;
+    s_queued_events.erase(it);
+
+    JsonDocument doc;
+    event.build(event.state, doc.createNestedObject(event_name(event.type)));
+    return print(doc);
+}
+
+void enqueue(const QueuedEvent& event) {
+    if (event.key != NO_KEY) {
+        const auto it = std::find_if(s_queued_events.begin(), s_queued_events.end(), [&](const QueuedEvent& queued) {
+            return queued.type == event.type and queued.key == event.key;
+        });
+        // what it says is replaced, and it goes to the back of the queue so it's never written before events posted in between
+        if (it != s_queued_events.end()) {
+            const auto priority = std::max(it->priority, event.priority);
+            *it = event;
+            it->sequence = s_next_sequence++;
+            it->priority = priority;
+            return;
+        }
+    }
+
+    // nothing is ever dropped, if there's no room the most urgent one is written now
+    if (s_queued_events.is_full())
+        write_next_queued_event();
+
+    s_queued_events.push_back(event);
+    s_queued_events[s_queued_events.size() - 1].sequence = s_next_sequence++;
+}
+
+static void drain_queued_events() {
+    // what's written in a single tick, enough for a few events without holding the loop for long
+    constexpr usize BYTES_PER_TICK = 512;
+    // the serialization of the events is left for after a step that's about to start
+    constexpr millis_t STEP_MARGIN = 50;
+
+    if (s_queued_events.is_empty())
+        return;
+
+    if (const auto time = RecipeQueue::the().time_until_next_step(); time and *time < STEP_MARGIN)
+        return;
+
+    usize written = 0;
+    while (not s_queued_events.is_empty() and written < BYTES_PER_TICK)
+        written += write_next_queued_event();
+}
+
+void flush_queued_events() {
+    while (not s_queued_events.is_empty())
+        write_next_queued_event();
 }
 }
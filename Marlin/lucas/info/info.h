@@ -4,6 +4,7 @@
 #include <lucas/serial/FirmwareUpdateHook.h>
 #include <lucas/util/util.h>
 #include <span>
+#include <new>
 
 namespace lucas::info {
 constexpr usize BUFFER_SIZE = 2048;
@@ -11,10 +12,28 @@ using JsonDocument = StaticJsonDocument<BUFFER_SIZE>;
 
 void tick();
 
-void print_json(const JsonDocument& doc);
+// how the events are written to the host, the commands are accepted in both all the time
+// the host asks for the binary one when it connects, the machine always starts with json so the ones that don't know about it keep working
+enum class Protocol {
+    Json,
+    // messagepack inside the frames of `serial::FrameHook`
+    MessagePack
+};
+
+Protocol protocol();
+
+void set_protocol(Protocol);
+
+// writes the document with the protocol in use, along with the credit of the host if it moved
+// returns how many bytes were written
+usize print(JsonDocument& doc);
+
+usize print_json(const JsonDocument& doc);
 
 void interpret_command_from_host(std::span<char>);
 
+void interpret_frame_from_host(std::span<char>);
+
 // https://www.notion.so/Eventos-informa-es-enviadas-da-m-quina-para-o-app-93dca4c7c1984aa38ffd5bddbe2c22a2?pvs=4
 enum class Event {
     Boiler = 0,
@@ -27,8 +46,8 @@ enum class Event {
     Other
 };
 
-void send(Event type, util::Fn<void, JsonObject> auto&& callback) {
-    constexpr static auto EVENT_NAMES = std::to_array({
+constexpr const char* event_name(Event type) {
+    constexpr auto EVENT_NAMES = std::to_array({
         [usize(Event::Boiler)] = "infoBoiler",
         [usize(Event::Recipe)] = "infoRecipe",
         [usize(Event::Station)] = "infoStation",
@@ -38,12 +57,65 @@ void send(Event type, util::Fn<void, JsonObject> auto&& callback) {
         [usize(Event::Firmware)] = "infoFirmware",
         [usize(Event::Other)] = "infoOther",
     });
+    return EVENT_NAMES[usize(type)];
+}
 
+// builds and writes the event right away, for the answers to the host and whatever has to go out in order with everything else
+void send(Event type, util::Fn<void, JsonObject> auto&& callback) {
     JsonDocument doc;
-    std::invoke(FWD(callback), doc.createNestedObject(EVENT_NAMES[usize(type)]));
-    print_json(doc);
+    std::invoke(FWD(callback), doc.createNestedObject(event_name(type)));
+    print(doc);
 }
 
+// the more urgent events always leave the queue first
+enum class Priority {
+    Telemetry = 0,
+    Recipe,
+    Security
+};
+
+// the posted events of the same type and key replace each other in the queue, so only the latest one goes out
+// the ones posted with this are never replaced
+constexpr u16 NO_KEY = 0xFFFF;
+
+struct QueuedEvent {
+    static constexpr usize STATE_SIZE = 32;
+
+    Event type = Event::Other;
+    Priority priority = Priority::Telemetry;
+    u16 key = NO_KEY;
+    // the order in which they were posted, among the ones of the same priority the oldest goes first
+    u32 sequence = 0;
+    void (*build)(const void* state, JsonObject) = nullptr;
+    alignas(std::max_align_t) u8 state[STATE_SIZE] = {};
+};
+
+void enqueue(const QueuedEvent&);
+
+// like `send`, but the document is only built and written by `tick`, when there's time and room in the port for it, so posting costs
+// almost nothing to the caller. the callback is copied into the queue, so whatever it captures has to be captured by value, and what it
+// reads through `this` is read when it's written and not when it's posted
+template<typename Callback>
+requires util::Fn<const Callback&, void, JsonObject>
+void post(Event type, Priority priority, u16 key, Callback callback) {
+    static_assert(sizeof(Callback) <= QueuedEvent::STATE_SIZE, "o estado do evento nao cabe na fila");
+    static_assert(std::is_trivially_copyable_v<Callback> and std::is_trivially_destructible_v<Callback>);
+
+    QueuedEvent event = {
+        .type = type,
+        .priority = priority,
+        .key = key,
+        .build = [](const void* state, JsonObject o) {
+            std::invoke(*static_cast<const Callback*>(state), o);
+        },
+    };
+    new (event.state) Callback(callback);
+    enqueue(event);
+}
+
+// writes every queued event right away, for when the machine is about to stop answering, like right before a reset
+void flush_queued_events();
+
 enum class Command {
     RequestInfoCalibration = 0,
     InitializeStations,
@@ -54,10 +126,19 @@ enum class Command {
     FirmwareUpdate,
     RequestInfoFirmware,
     SetFixedRecipes,
+    RequestPourRecords,
+    TuneBoiler,
+    SetProtocol,
+    SetFlowControl,
 
     /* ~comandos de desenvolvimento~ */
     DevScheduleStandardRecipe,
     DevSimulateButtonPress,
+    DevRequestDispatchStats,
+    DevSetFlowLoopGains,
+    DevInformPouredVolume,
+    DevSetPourMismatchThresholds,
+    DevRequestSerialStats,
 
     Count,
 
@@ -0,0 +1,31 @@
+#include "CreditWindow.h"
+#include <lucas/lucas.h>
+
+namespace lucas::serial {
+void CreditWindow::enable() {
+    m_enabled = true;
+    m_consumed = 0;
+    m_advertised_edge = 0;
+
+    LOG_IF(LogSerial, "controle de fluxo por credito ativado - [janela = ", WINDOW, "]");
+
+    // the answer to the host is the first edge
+    info::JsonDocument doc;
+    info::print(doc);
+}
+
+void CreditWindow::tick() {
+    if (m_enabled and edge() - m_advertised_edge >= ADVERTISE_STEP) {
+        info::JsonDocument doc;
+        info::print(doc);
+    }
+}
+
+void CreditWindow::piggyback(info::JsonDocument& doc) {
+    if (not m_enabled or edge() == m_advertised_edge)
+        return;
+
+    m_advertised_edge = edge();
+    doc["rx"] = m_advertised_edge;
+}
+}
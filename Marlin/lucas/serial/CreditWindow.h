@@ -0,0 +1,47 @@
+#pragma once
+
+#include <lucas/info/info.h>
+#include <lucas/util/Singleton.h>
+#include <lucas/types.h>
+
+namespace lucas::serial {
+// credit based flow control, which the host asks for instead of waiting for an `okToReceive` every `Hook::MAX_BUFFER_SLICE` bytes
+// the machine advertises, as `rx` at the root of the messages, up to which byte the host may write, counting from the one right after the
+// message that enabled it. that edge moves forward as the hooks take bytes out of the rx buffer of the port, so the host can keep a whole
+// buffer of bytes in flight and write at the speed of the line, while the buffer never overflows
+class CreditWindow : public util::Singleton<CreditWindow> {
+public:
+    void enable();
+
+    void disable() { m_enabled = false; }
+
+    bool enabled() const { return m_enabled; }
+
+    // every byte taken out of the port goes through here, whoever reads it
+    void consume(usize bytes) { m_consumed += bytes; }
+
+    // sends the edge on its own if the host has been left with too little of the window and nothing else went out
+    void tick();
+
+    // adds the edge to a message that's about to be sent, if it moved since the last one
+    void piggyback(info::JsonDocument& doc);
+
+    u32 edge() const { return m_consumed + WINDOW; }
+
+    // the rx buffer holds one byte less than its size
+    static constexpr u32 WINDOW = RX_BUFFER_SIZE - 1;
+
+    // how much the edge has to move before it's worth a message of its own
+    static constexpr u32 ADVERTISE_STEP = WINDOW / 4;
+
+private:
+    friend class util::Singleton<CreditWindow>;
+    CreditWindow() = default;
+
+    bool m_enabled = false;
+
+    // they wrap around, and so do the ones of the host
+    u32 m_consumed = 0;
+    u32 m_advertised_edge = 0;
+};
+}
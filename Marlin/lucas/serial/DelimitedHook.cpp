@@ -1,17 +1,17 @@
 #include "DelimitedHook.h"
 #include <lucas/lucas.h>
+#include <lucas/serial/serial.h>
 
 namespace lucas::serial {
 DelimitedHook::List DelimitedHook::s_hooks = {};
 
 void DelimitedHook::think() {
-    static DelimitedHook* s_active_hook = nullptr;
     while (SERIAL_IMPL.available()) {
         const auto peek = SERIAL_IMPL.peek();
         if (not s_active_hook) {
             DelimitedHook::for_each([&](auto& hook) {
                 if (hook.delimiter() == peek) {
-                    SERIAL_IMPL.read();
+                    read_byte();
                     hook.begin();
                     s_active_hook = &hook;
                     LOG_IF(LogSerial, "hook ativado - [delimitador = '", AS_CHAR(hook.delimiter()), "']");
@@ -23,11 +23,11 @@ void DelimitedHook::think() {
             auto hook = s_active_hook;
             if (hook->delimiter() == peek) {
                 LOG_IF(LogSerial, "hook finalizado - [size = ", hook->buffer_size(), "]");
-                SERIAL_IMPL.read();
+                read_byte();
                 s_active_hook = nullptr;
                 hook->dispatch();
             } else {
-                hook->add_to_buffer(SERIAL_IMPL.read());
+                hook->add_to_buffer(read_byte());
             }
         }
 
@@ -20,6 +20,8 @@ public:
                 break;
     }
 
+    static bool is_receiving() { return s_active_hook; }
+
     char delimiter() const { return m_delimiter; }
 
     void begin() { m_counter = 1; }
@@ -31,6 +33,7 @@ private:
     char m_delimiter = 0;
 
     static List s_hooks;
+    static inline DelimitedHook* s_active_hook = nullptr;
     static inline usize s_hooks_size = 0;
     DelimitedHook() = default;
 };
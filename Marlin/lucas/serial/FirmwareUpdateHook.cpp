@@ -1,29 +1,140 @@
 #include "FirmwareUpdateHook.h"
 #include <lucas/lucas.h>
 #include <lucas/info/info.h>
+#include <lucas/serial/serial.h>
 
 namespace lucas::serial {
+void FirmwareUpdateHook::activate(Callbacks callbacks, usize image_size, usize start_offset, bool verified) {
+    deactivate();
+
+    m_active = true;
+    m_callbacks = callbacks;
+    m_image_size = image_size;
+    m_next_offset = start_offset;
+    m_verified = verified;
+    m_chunks[0].data = m_buffer;
+    m_chunks[1].data = m_second_buffer;
+    // the host has as long to start writing as it has between any two bytes
+    m_receive_timer.restart();
+}
+
+void FirmwareUpdateHook::deactivate() {
+    m_active = false;
+    m_callbacks = {};
+    m_image_size = 0;
+    m_next_offset = 0;
+    m_verified = false;
+    m_chunks = {};
+    m_receiving = 0;
+    m_writing = 0;
+    m_chunk_crc_size = 0;
+    m_discarding = false;
+    m_receive_timer.stop();
+    reset();
+}
+
 void FirmwareUpdateHook::think() {
-    if (m_receive_timer >= 5s) {
-        if (m_on_error_callback)
-            m_on_error_callback(1);
+    if (m_discarding) {
+        while (SERIAL_IMPL.available()) {
+            read_byte();
+            m_receive_timer.restart();
+        }
+
+        if (m_receive_timer >= DISCARD_GAP) {
+            m_discarding = false;
+            m_receive_timer.restart();
+        }
+        return;
+    }
+
+    if (m_next_offset < m_image_size and m_receive_timer >= RECEIVE_TIMEOUT) {
+        m_callbacks.on_error(Timeout);
         return;
     }
 
-    while (SERIAL_IMPL.available()) {
+    // the port is only read while there's a chunk to receive into, otherwise the bytes wait in its rx buffer
+    while (SERIAL_IMPL.available() and m_next_offset < m_image_size and not m_chunks[m_receiving].ready and not m_discarding) {
         m_receive_timer.restart();
-        receive_char(SERIAL_IMPL.read());
+        receive_char(char(read_byte()));
     }
+
+    write_next_block();
 }
 
 void FirmwareUpdateHook::receive_char(char c) {
-    m_buffer[m_buffer_size++] = c;
-    m_bytes_received++;
-    if (m_buffer_size == MAX_BUFFER_SIZE or m_bytes_received == m_bytes_to_receive) {
-        dispatch();
-    } else if (++m_counter >= MAX_BUFFER_SLICE) {
+    auto& chunk = m_chunks[m_receiving];
+    if (chunk.size < expected_chunk_size())
+        chunk.data[chunk.size++] = c;
+    else
+        m_chunk_crc[m_chunk_crc_size++] = u8(c);
+
+    if (++m_counter >= MAX_BUFFER_SLICE) {
         m_counter = 0;
         ok_to_receive();
     }
+
+    if (chunk.size == expected_chunk_size() and (not m_verified or m_chunk_crc_size == sizeof(m_chunk_crc)))
+        complete_chunk();
+}
+
+void FirmwareUpdateHook::complete_chunk() {
+    auto& chunk = m_chunks[m_receiving];
+    if (m_verified) {
+        const auto expected = u32(m_chunk_crc[0]) | u32(m_chunk_crc[1]) << 8 | u32(m_chunk_crc[2]) << 16 | u32(m_chunk_crc[3]) << 24;
+        if (util::crc32({ reinterpret_cast<const u8*>(chunk.data), chunk.size }) != expected) {
+            reject_chunk();
+            return;
+        }
+    }
+
+    m_chunk_crc_size = 0;
+    m_next_offset += chunk.size;
+    chunk.written = 0;
+    chunk.ready = true;
+
+    // if the other one is still being written the port waits for it
+    m_receiving = (m_receiving + 1) % m_chunks.size();
+}
+
+void FirmwareUpdateHook::reject_chunk() {
+    LOG_ERR("parte do firmware corrompida, descartando - [offset = ", m_next_offset, "]");
+
+    m_chunks[m_receiving].size = 0;
+    m_chunk_crc_size = 0;
+    // the host counts its slices again from the chunk it writes again
+    m_counter = 0;
+    m_discarding = true;
+    m_receive_timer.restart();
+
+    info::send(
+        info::Event::Firmware,
+        [offset = m_next_offset](JsonObject o) {
+            o["updateChunkRejected"] = offset;
+        });
+}
+
+void FirmwareUpdateHook::write_next_block() {
+    auto& chunk = m_chunks[m_writing];
+    if (not chunk.ready)
+        return;
+
+    const auto size = std::min(BLOCK_SIZE, chunk.size - chunk.written);
+    if (not m_callbacks.write({ chunk.data + chunk.written, size })) {
+        m_callbacks.on_error(WriteFailed);
+        return;
+    }
+
+    chunk.written += size;
+    if (chunk.written < chunk.size)
+        return;
+
+    m_callbacks.chunk_written({ chunk.data, chunk.size });
+    // the last chunk finishes the update, one way or another
+    if (not m_active)
+        return;
+
+    chunk.ready = false;
+    chunk.size = 0;
+    m_writing = (m_writing + 1) % m_chunks.size();
 }
 }
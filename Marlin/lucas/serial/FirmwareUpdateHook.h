@@ -5,44 +5,88 @@
 #include <lucas/util/Singleton.h>
 
 namespace lucas::serial {
+// receives the image of a new firmware, which the host writes raw to the port in chunks of `CHUNK_SIZE`, each one followed by its crc32 when
+// the update is verified. there are two chunks in memory, one being received while the other is written, a block at a time, so the port
+// keeps being read between the writes instead of sitting idle until a whole chunk is on the card
 class FirmwareUpdateHook : public Hook, public util::Singleton<FirmwareUpdateHook> {
 public:
-    using OnError = void (*)(int error_code);
-
-    void activate(Hook::Callback callback, OnError on_error_callback, usize bytes_to_receive) {
-        m_active = true;
-        m_callback = callback;
-        m_on_error_callback = on_error_callback;
-        m_bytes_to_receive = bytes_to_receive;
-        m_bytes_received = 0;
-    }
-
-    void deactivate() {
-        m_active = false;
-        m_callback = nullptr;
-        m_on_error_callback = nullptr;
-        m_bytes_to_receive = 0;
-        m_bytes_received = 0;
-        m_receive_timer.stop();
-        reset();
-        memset(m_buffer, 0, sizeof(m_buffer));
-    }
+    // every chunk but the last one has this many bytes of the image
+    static constexpr usize CHUNK_SIZE = MAX_BUFFER_SIZE;
+
+    // what's written to the card between reads of the port
+    static constexpr usize BLOCK_SIZE = 512;
+
+    enum ErrorCode {
+        WriteFailed = 0,
+        Timeout = 1,
+        ImageMismatch = 2,
+    };
+
+    struct Callbacks {
+        // writes the next piece of the image, returns false if it failed
+        bool (*write)(std::span<const char>) = nullptr;
+        // the chunk was written whole
+        void (*chunk_written)(std::span<const char>) = nullptr;
+        void (*on_error)(ErrorCode) = nullptr;
+    };
+
+    void activate(Callbacks callbacks, usize image_size, usize start_offset, bool verified);
+
+    void deactivate();
 
     bool active() const { return m_active; }
 
     void think();
 
+private:
+    friend class util::Singleton<FirmwareUpdateHook>;
+    FirmwareUpdateHook() = default;
+
+    struct Chunk {
+        char* data = nullptr;
+        usize size = 0;
+        usize written = 0;
+        // received whole and waiting to be written
+        bool ready = false;
+    };
+
     void receive_char(char c);
 
-private:
+    void complete_chunk();
+
+    void reject_chunk();
+
+    void write_next_block();
+
+    usize expected_chunk_size() const { return std::min(CHUNK_SIZE, m_image_size - m_next_offset); }
+
     bool m_active = false;
 
-    OnError m_on_error_callback = nullptr;
+    Callbacks m_callbacks = {};
+
+    bool m_verified = false;
+
+    usize m_image_size = 0;
 
-    usize m_bytes_to_receive = 0;
+    // where in the image the chunk being received starts
+    usize m_next_offset = 0;
 
-    usize m_bytes_received = 0;
+    // the first chunk lives in `m_buffer`, the second one here
+    char m_second_buffer[CHUNK_SIZE] = {};
+    std::array<Chunk, 2> m_chunks = {};
+    usize m_receiving = 0;
+    usize m_writing = 0;
+
+    u8 m_chunk_crc[sizeof(u32)] = {};
+    usize m_chunk_crc_size = 0;
+
+    // after a bad chunk whatever the host already wrote is thrown away, and it starts over from that chunk once it stops writing
+    bool m_discarding = false;
 
     util::Timer m_receive_timer;
+
+    static constexpr auto RECEIVE_TIMEOUT = 5s;
+
+    static constexpr auto DISCARD_GAP = 50ms;
 };
 }
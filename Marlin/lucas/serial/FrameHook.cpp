@@ -0,0 +1,131 @@
+#include "FrameHook.h"
+#include <lucas/lucas.h>
+#include <lucas/info/info.h>
+#include <lucas/serial/DelimitedHook.h>
+#include <lucas/serial/serial.h>
+#include <src/libs/crc16.h>
+
+namespace lucas::serial {
+bool FrameHook::think() {
+    if (m_state == State::Discarding) {
+        while (SERIAL_IMPL.available()) {
+            read_byte();
+            m_receive_timer.restart();
+        }
+
+        if (m_receive_timer >= DISCARD_GAP) {
+            m_state = State::Idle;
+            m_receive_timer.stop();
+        }
+        return is_receiving();
+    }
+
+    if (m_state != State::Idle and m_receive_timer >= RECEIVE_TIMEOUT)
+        reject("timeout");
+
+    while (SERIAL_IMPL.available() and m_state != State::Discarding) {
+        if (m_state == State::Idle) {
+            if (DelimitedHook::is_receiving() or SERIAL_IMPL.peek() != START_OF_FRAME)
+                return false;
+
+            read_byte();
+            m_state = State::Length;
+            m_length = 0;
+            m_field_bytes = 0;
+            reset();
+        } else {
+            receive_byte(read_byte());
+        }
+        m_receive_timer.restart();
+    }
+
+    return is_receiving();
+}
+
+void FrameHook::receive_byte(u8 byte) {
+    switch (m_state) {
+    case State::Length:
+        m_length |= u16(byte) << (8 * m_field_bytes);
+        if (++m_field_bytes < sizeof(m_length))
+            break;
+
+        if (m_length == 0 or m_length > MAX_BUFFER_SIZE) {
+            reject("tamanho invalido");
+            break;
+        }
+
+        m_state = State::Payload;
+        break;
+    case State::Payload:
+        add_to_buffer(char(byte));
+        if (m_buffer_size == m_length) {
+            m_state = State::Checksum;
+            m_checksum = 0;
+            m_field_bytes = 0;
+        }
+        break;
+    case State::Checksum:
+        m_checksum |= u16(byte) << (8 * m_field_bytes);
+        if (++m_field_bytes == sizeof(m_checksum))
+            finish();
+        break;
+    case State::Idle:
+    case State::Discarding:
+        break;
+    }
+}
+
+void FrameHook::finish() {
+    const u8 header[] = { u8(m_length), u8(m_length >> 8) };
+    const auto payload = std::span{ reinterpret_cast<const u8*>(m_buffer), m_buffer_size };
+    if (checksum(header, payload) != m_checksum) {
+        reject("crc invalido");
+        return;
+    }
+
+    m_state = State::Idle;
+    m_receive_timer.stop();
+
+    const auto size = m_buffer_size;
+    ok_to_receive();
+    reset();
+
+    // the payload isn't text, so only its size is logged
+    LOG_IF(LogSerial, "frame recebido - [size = ", size, "]");
+    if (m_callback)
+        m_callback({ m_buffer, size });
+}
+
+void FrameHook::reject(const char* reason) {
+    LOG_ERR("frame descartado - [", reason, " | size = ", m_buffer_size, "]");
+
+    m_state = State::Discarding;
+    m_receive_timer.restart();
+    reset();
+
+    info::send(
+        info::Event::Other,
+        [reason](JsonObject o) {
+            o["frameRejected"] = reason;
+        });
+    ok_to_receive();
+}
+
+void FrameHook::send(std::span<const u8> payload) {
+    const u8 header[] = { u8(payload.size()), u8(payload.size() >> 8) };
+    const auto crc = checksum(header, payload);
+    const u8 trailer[] = { u8(crc), u8(crc >> 8) };
+
+    SERIAL_IMPL.write(START_OF_FRAME);
+    SERIAL_IMPL.write(header, sizeof(header));
+    SERIAL_IMPL.write(payload.data(), payload.size());
+    SERIAL_IMPL.write(trailer, sizeof(trailer));
+}
+
+u16 FrameHook::checksum(std::span<const u8> header, std::span<const u8> payload) {
+    u16 crc = 0xFFFF;
+    crc16(&crc, header.data(), header.size());
+    crc16(&crc, payload.data(), payload.size());
+    return crc;
+}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <lucas/serial/Hook.h>
+#include <lucas/util/Timer.h>
+#include <lucas/util/Singleton.h>
+
+namespace lucas::serial {
+// receives the binary frames of the host, which share the port with the delimited hooks
+// a frame is `START_OF_FRAME | length (u16) | payload | crc (u16)`, little endian, the crc being crc16-ccitt from 0xFFFF over the length and the payload
+// the payload is never printable text, so the frames can't be mistaken for anything else on the port
+class FrameHook : public Hook, public util::Singleton<FrameHook> {
+public:
+    static constexpr u8 START_OF_FRAME = 0x02;
+
+    // the bytes of a frame around its payload
+    static constexpr usize OVERHEAD = 1 + sizeof(u16) + sizeof(u16);
+
+    void set_callback(Hook::Callback callback) { m_callback = callback; }
+
+    // returns true while a frame is being received, in which case nothing else should read from the port
+    bool think();
+
+    bool is_receiving() const { return m_state != State::Idle; }
+
+    // writes a whole frame around `payload`
+    static void send(std::span<const u8> payload);
+
+    static u16 checksum(std::span<const u8> header, std::span<const u8> payload);
+
+private:
+    friend class util::Singleton<FrameHook>;
+    FrameHook() = default;
+
+    void receive_byte(u8);
+
+    void finish();
+
+    void reject(const char* reason);
+
+    enum class State {
+        Idle,
+        Length,
+        Payload,
+        Checksum,
+        // after a bad frame the rest of it is thrown away until the host stops writing, it can't be told apart from a new one
+        Discarding
+    };
+
+    State m_state = State::Idle;
+
+    u16 m_length = 0;
+    u16 m_checksum = 0;
+    usize m_field_bytes = 0;
+
+    util::Timer m_receive_timer;
+
+    // the host writes a whole frame at once, so a gap this long means some of it was lost
+    static constexpr auto RECEIVE_TIMEOUT = 1s;
+
+    static constexpr auto DISCARD_GAP = 20ms;
+};
+}
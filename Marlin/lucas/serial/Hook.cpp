@@ -3,6 +3,7 @@
 #include <src/MarlinCore.h>
 #include <lucas/lucas.h>
 #include <lucas/info/info.h>
+#include <lucas/serial/CreditWindow.h>
 
 namespace lucas::serial {
 bool Hook::is_valid() const {
@@ -35,6 +36,10 @@ void Hook::reset() {
 }
 
 void Hook::ok_to_receive() {
+    // with credits the host never waits for this
+    if (CreditWindow::the().enabled())
+        return;
+
     info::send(
         info::Event::Other,
         [](JsonObject o) {
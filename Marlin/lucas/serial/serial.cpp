@@ -4,6 +4,8 @@
 #include <lucas/info/info.h>
 #include <lucas/serial/DelimitedHook.h>
 #include <lucas/serial/FirmwareUpdateHook.h>
+#include <lucas/serial/FrameHook.h>
+#include <lucas/serial/CreditWindow.h>
 #include <lucas/cmd/cmd.h>
 #include <src/core/serial.h>
 
@@ -11,15 +13,58 @@ namespace lucas::serial {
 void setup() {
     DelimitedHook::make('#', &info::interpret_command_from_host);
     DelimitedHook::make('$', &cmd::interpret_gcode_from_host);
+    FrameHook::the().set_callback(&info::interpret_frame_from_host);
 }
 
 void hooks() {
     if (FirmwareUpdateHook::the().active()) {
         FirmwareUpdateHook::the().think();
-    } else {
+    } else if (not FrameHook::the().think()) {
         DelimitedHook::think();
     }
+
+    CreditWindow::the().tick();
+}
+
+u8 read_byte() {
+    CreditWindow::the().consume(1);
+    return u8(SERIAL_IMPL.read());
+}
+
+#ifdef SERIAL_TX_LOW_PRIORITY
+HighPriorityOutput::HighPriorityOutput()
+    : m_previous(MYSERIAL1.tx_high_priority()) {
+    MYSERIAL1.set_tx_high_priority(true);
+}
+
+HighPriorityOutput::~HighPriorityOutput() {
+    MYSERIAL1.set_tx_high_priority(m_previous);
+}
+
+void send_output_stats(bool reset) {
+    const auto stats = MYSERIAL1.tx_stats();
+    if (reset)
+        MYSERIAL1.reset_tx_stats();
+
+    info::send(
+        info::Event::Other,
+        [&stats](JsonObject o) {
+            auto obj = o.createNestedObject("serialOutput");
+            obj["capacity"] = SERIAL_TX_BUFFER_SIZE - 1;
+            obj["highWater"] = stats.high_water;
+            obj["droppedLines"] = stats.dropped_lines;
+            obj["droppedBytes"] = stats.dropped_bytes;
+        });
+}
+#else
+HighPriorityOutput::HighPriorityOutput() = default;
+
+HighPriorityOutput::~HighPriorityOutput() = default;
+
+void send_output_stats(bool) {
+    LOG_ERR("estatisticas de saida da serial indisponiveis");
 }
+#endif
 
 void clean_serial() {
     while (SERIAL_IMPL.available())
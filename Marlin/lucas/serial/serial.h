@@ -8,4 +8,21 @@ void setup();
 void hooks();
 
 void clean_serial();
+
+// takes a byte out of the port, the hooks never read it in any other way so the credits of the host stay right
+u8 read_byte();
+
+// what's written while this lives waits for room in the tx buffer if it has to, everything else is a log that the port drops a line at a
+// time when it falls behind, so the events always get to the host and the logs never hold the loop
+class HighPriorityOutput {
+public:
+    HighPriorityOutput();
+    ~HighPriorityOutput();
+
+private:
+    bool m_previous = false;
+};
+
+// the high-water mark of the tx buffer and how much was dropped from it, `reset` zeroes them after they're sent
+void send_output_stats(bool reset);
 }
@@ -38,6 +38,8 @@ public:
         }
     }
 
+    usize size() const { return m_file ? m_file->file_size() : 0; }
+
     template<typename T>
     T read_binary() {
         T result;
@@ -58,6 +58,14 @@ void Card::delete_file(const char* path) {
     File::remove(&m_root, path);
 }
 
+bool Card::rename_file(File& file, const char* path) {
+    if (not m_mounted)
+        return false;
+
+    File::remove(&m_root, path);
+    return file.rename(&m_root, path);
+}
+
 Card::InsertionState Card::insertion_state() const {
     return digitalRead(SD_DETECT_PIN) == SD_DETECT_STATE ? InsertionState::Inserted : InsertionState::Removed;
 }
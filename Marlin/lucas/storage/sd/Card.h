@@ -19,6 +19,9 @@ public:
 
     void delete_file(const char* path);
 
+    // replaces whatever file was already at `path`
+    bool rename_file(File&, const char* path);
+
     bool is_mounted() const { return m_mounted; }
 
 private:
@@ -31,6 +31,15 @@ public:
         SdBaseFile::truncate(pos);
     }
 
+    // writes whatever is still in the cache of the card along with the size of the file, which is only done on its own with `O_SYNC`
+    bool sync() {
+        return SdBaseFile::sync();
+    }
+
+    bool seek(usize pos) {
+        return seekSet(pos);
+    }
+
     constexpr static auto MAX_ATTEMPTS = 3;
 
     template<typename T>
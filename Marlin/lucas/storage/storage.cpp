@@ -2,7 +2,7 @@
 #include <lucas/storage/sd/Card.h>
 
 namespace lucas::storage {
-static std::array<Entry::Id, 10> s_entry_identifiers{};
+static std::array<Entry::Id, 16> s_entry_identifiers{};
 static usize s_current_entry = 0;
 
 void setup() {
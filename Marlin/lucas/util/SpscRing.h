@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <optional>
+#include <lucas/types.h>
+
+namespace lucas::util {
+// a fixed size queue with a single producer and a single consumer, usually an interrupt and the main loop
+// neither side ever waits for the other: each index is only ever written by its own side
+// the fences only keep the compiler from reordering the accesses, which is all a single core needs
+template<typename T, usize Size>
+class SpscRing {
+    static_assert(Size and (Size & (Size - 1)) == 0, "the size of the ring must be a power of two");
+
+public:
+    // producer side, returns false if the ring is full
+    bool push(const T& value) {
+        const usize head = m_head;
+        if (head - m_tail == Size)
+            return false;
+
+        m_storage[head & MASK] = value;
+        std::atomic_signal_fence(std::memory_order_release);
+        m_head = head + 1;
+        return true;
+    }
+
+    // consumer side
+    std::optional<T> pop() {
+        const usize tail = m_tail;
+        if (tail == m_head)
+            return std::nullopt;
+
+        std::atomic_signal_fence(std::memory_order_acquire);
+        const auto value = m_storage[tail & MASK];
+        std::atomic_signal_fence(std::memory_order_release);
+        m_tail = tail + 1;
+        return value;
+    }
+
+    usize size() const { return m_head - m_tail; }
+
+    bool is_empty() const { return size() == 0; }
+
+    bool is_full() const { return size() == Size; }
+
+    static constexpr usize capacity() { return Size; }
+
+private:
+    static constexpr usize MASK = Size - 1;
+
+    std::array<T, Size> m_storage = {};
+    // free running, only wrapped when indexing, so that `head - tail` is always the size
+    volatile usize m_head = 0;
+    volatile usize m_tail = 0;
+};
+}
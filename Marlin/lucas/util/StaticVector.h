@@ -3,7 +3,9 @@
 #include <array>
 #include <cstddef>
 #include <utility>
+#include <algorithm>
 #include <src/MarlinCore.h>
+#include <lucas/util/util.h>
 
 namespace lucas::util {
 template<typename T, usize Size>
@@ -24,6 +26,22 @@ public:
         m_storage[--m_size].~T();
     }
 
+    void insert(Storage::iterator position, T value) {
+        std::move_backward(position, end(), std::next(end()));
+        *position = std::move(value);
+        ++m_size;
+    }
+
+    void erase(Storage::iterator position) {
+        std::move(std::next(position), end(), position);
+        --m_size;
+    }
+
+    void erase_if(auto&& predicate) {
+        const auto new_end = std::remove_if(begin(), end(), FWD(predicate));
+        m_size = std::distance(begin(), new_end);
+    }
+
     void clear() {
         m_size = 0;
     }
@@ -32,6 +50,10 @@ public:
         return m_size == 0;
     }
 
+    bool is_full() const {
+        return m_size == Size;
+    }
+
     Storage::const_iterator min() const {
         return std::min_element(begin(), end());
     }
@@ -17,4 +17,22 @@ bool is_button_held(pin_t pin) {
 float normalize(float v, float min, float max) {
     return (v - min) / (max - min);
 }
+
+static constexpr auto CRC32_TABLE = [] {
+    std::array<u32, 256> table = {};
+    for (u32 i = 0; i < table.size(); ++i) {
+        auto crc = i;
+        for (usize bit = 0; bit < 8; ++bit)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        table[i] = crc;
+    }
+    return table;
+}();
+
+u32 crc32(std::span<const u8> data, u32 crc) {
+    crc = ~crc;
+    for (const auto byte : data)
+        crc = CRC32_TABLE[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
 }
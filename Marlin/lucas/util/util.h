@@ -7,11 +7,13 @@
 #include <chrono>
 #include <string_view>
 #include <concepts>
+#include <span>
 
 namespace lucas {
 namespace chrono = std::chrono;
 using namespace std::literals;
 namespace util {
+// worst case travel time, used whenever the real time between two locations is unknown
 constexpr millis_t TRAVEL_MARGIN = 1000;
 
 enum class Iter {
@@ -39,6 +41,9 @@ bool is_button_held(pin_t pin);
 
 float normalize(float v, float min, float max);
 
+// the usual crc32 (ieee 802.3, the one of zlib), continued from `crc` so it can be computed over pieces
+u32 crc32(std::span<const u8> data, u32 crc = 0);
+
 template<millis_t INTERVAL>
 bool elapsed(millis_t last) {
     return millis() - last >= INTERVAL;
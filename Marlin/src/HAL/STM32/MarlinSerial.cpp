@@ -107,4 +107,56 @@ void MarlinSerial::_rx_complete_irq(serial_t *obj) {
   }
 }
 
+#if ENABLED(SERIAL_TX_LOW_PRIORITY)
+
+  // Decides, for a low priority byte, whether it goes out or is dropped along with the rest of its line
+  bool MarlinSerial::_tx_drop(const uint8_t c) {
+    const bool line_start = _tx_line_start;
+    _tx_line_start = (c == '\n');
+
+    if (_tx_dropping_line) {
+      _tx_stats.dropped_bytes++;
+      if (c == '\n') _tx_dropping_line = false;
+      return true;
+    }
+
+    // The line break of a line that made it out always goes too
+    if (c == '\n' && !line_start) return false;
+
+    const int room = availableForWrite();
+    if (room < (line_start ? SERIAL_TX_LOW_PRIORITY_RESERVE : SERIAL_TX_LOW_PRIORITY_RESERVE / 2)) {
+      _tx_stats.dropped_lines++;
+      _tx_stats.dropped_bytes++;
+      _tx_dropping_line = (c != '\n');
+      // A line cut short still gets its line break, so the host doesn't glue the next one to it
+      if (!line_start) HardwareSerial::write('\n');
+      return true;
+    }
+    return false;
+  }
+
+  void MarlinSerial::_tx_update_high_water() {
+    const uint16_t queued = SERIAL_TX_BUFFER_SIZE - 1 - availableForWrite();
+    NOLESS(_tx_stats.high_water, queued);
+  }
+
+  size_t MarlinSerial::write(uint8_t c) {
+    if (!_tx_high_priority && _tx_drop(c)) return 1;
+    const size_t written = HardwareSerial::write(c);
+    _tx_update_high_water();
+    return written;
+  }
+
+  size_t MarlinSerial::write(const uint8_t *buffer, size_t size) {
+    if (_tx_high_priority) {
+      const size_t written = HardwareSerial::write(buffer, size);
+      _tx_update_high_water();
+      return written;
+    }
+    for (size_t i = 0; i < size; ++i) write(buffer[i]);
+    return size;
+  }
+
+#endif // SERIAL_TX_LOW_PRIORITY
+
 #endif // HAL_STM32
@@ -31,6 +31,18 @@
 
 typedef void (*usart_rx_callback_t)(serial_t * obj);
 
+#if ENABLED(SERIAL_TX_LOW_PRIORITY)
+  // Low priority lines are dropped once fewer than this many bytes are left in the TX buffer,
+  // which keeps the rest of it for the high priority output
+  #define SERIAL_TX_LOW_PRIORITY_RESERVE (SERIAL_TX_BUFFER_SIZE / 4)
+
+  struct SerialTxStats {
+    uint16_t high_water;      // The most bytes ever waiting in the TX buffer
+    uint32_t dropped_lines,   // Low priority lines dropped, whole or in part
+             dropped_bytes;
+  };
+#endif
+
 struct MarlinSerial : public HardwareSerial {
   MarlinSerial(void *peripheral, usart_rx_callback_t rx_callback) :
       HardwareSerial(peripheral), _rx_callback(rx_callback)
@@ -41,8 +53,35 @@ struct MarlinSerial : public HardwareSerial {
 
   void _rx_complete_irq(serial_t *obj);
 
+  #if ENABLED(SERIAL_TX_LOW_PRIORITY)
+    // The TX buffer is drained by the USART interrupt, so a write only waits on the port when it's full.
+    // Low priority output (the default) is dropped a line at a time instead of waiting.
+    using HardwareSerial::write;
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+
+    bool tx_high_priority() const { return _tx_high_priority; }
+    void set_tx_high_priority(const bool high) {
+      _tx_high_priority = high;
+      // Whatever comes next starts a new line as far as dropping is concerned
+      _tx_line_start = true;
+      _tx_dropping_line = false;
+    }
+
+    const SerialTxStats& tx_stats() const { return _tx_stats; }
+    void reset_tx_stats() { _tx_stats = {}; }
+  #endif
+
 protected:
   usart_rx_callback_t _rx_callback;
+
+  #if ENABLED(SERIAL_TX_LOW_PRIORITY)
+    bool _tx_high_priority = false, _tx_line_start = true, _tx_dropping_line = false;
+    SerialTxStats _tx_stats{};
+
+    bool _tx_drop(const uint8_t c);
+    void _tx_update_high_water();
+  #endif
 };
 
 typedef Serial1Class<MarlinSerial> MSerialT;
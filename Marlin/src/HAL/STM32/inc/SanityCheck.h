@@ -109,3 +109,9 @@
 #endif
 #undef CHECK_SERIAL_PIN
 #undef _CHECK_SERIAL_PIN
+
+#if ENABLED(SERIAL_TX_LOW_PRIORITY)
+  #if SERIAL_PORT == -1
+    #error "SERIAL_TX_LOW_PRIORITY requires a hardware SERIAL_PORT."
+  #endif
+#endif
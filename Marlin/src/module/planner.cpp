@@ -128,6 +128,7 @@ volatile uint8_t Planner::block_buffer_head, // Index of the next block to be pu
     Planner::block_buffer_tail;              // Index of the busy block, if any
 uint16_t Planner::cleaning_buffer_counter;   // A counter to disable queuing of blocks
 uint8_t Planner::delay_before_delivering;    // This counter delays delivery of blocks when queue becomes empty to allow the opportunity of merging blocks
+uint16_t Planner::next_flow_tag = 0;         // Flow tag given to every new block, see lucas::Spout
 
 planner_settings_t Planner::settings; // Initialized by settings.load()
 
@@ -2373,6 +2374,8 @@ bool Planner::_populate_block(
     // Set direction bits
     block->direction_bits = dm;
 
+    block->flow_tag = next_flow_tag;
+
 /**
  * Update block laser power
  * For standard mode get the cutter.power value for processing, since it's
@@ -279,6 +279,8 @@ typedef struct PlannerBlock {
     block_laser_t laser;
   #endif
 
+  uint16_t flow_tag;                        // Flow scale for the spout while this block runs, see lucas::Spout
+
   void reset() { memset((char*)this, 0, sizeof(*this)); }
 
 } block_t;
@@ -398,6 +400,7 @@ class Planner {
     static uint16_t cleaning_buffer_counter;        // A counter to disable queuing of blocks
     static uint8_t delay_before_delivering;         // This counter delays delivery of blocks when queue becomes empty to allow the opportunity of merging blocks
 
+    static uint16_t next_flow_tag;                  // Flow tag given to every new block, see lucas::Spout
 
     #if ENABLED(DISTINCT_E_FACTORS)
       static uint8_t last_extruder;                 // Respond to extruder change
@@ -96,6 +96,7 @@ Stepper stepper; // Singleton
 #include "../sd/cardreader.h"
 #include "../MarlinCore.h"
 #include "../HAL/shared/Delay.h"
+#include <lucas/Spout.h>
 
 #if ENABLED(BD_SENSOR)
   #include "../feature/bedlevel/bdl/bdl.h"
@@ -2385,6 +2386,9 @@ uint32_t Stepper::block_phase_isr() {
         recovery.info.current_position = current_block->start_position;
       #endif
 
+      // The spout picks up the flow of the block on its next tick
+      if (current_block->flow_tag) lucas::Spout::s_block_flow_tag = current_block->flow_tag;
+
       #if ENABLED(DIRECT_STEPPING)
         if (current_block->is_page()) {
           page_step_state.segment_steps = 0;
@@ -1406,6 +1406,11 @@ void Temperature::min_temp_error(const heater_id_t heater_id) {
 bool Temperature::pid_debug_flag; // = false
 #endif
 
+#if ENABLED(PIDTEMP)
+float Temperature::hotend_feed_forward; // = 0
+bool Temperature::hotend_open_loop; // = false
+#endif
+
 #if HAS_PID_HEATING
 
 template<typename TT, int MIN_POW, int MAX_POW>
@@ -1497,7 +1502,11 @@ float Temperature::get_pid_output_hotend(const uint8_t E_NAME) {
         REPEAT(HOTENDS, _HOTENDPID)
     };
 
-    const float pid_output = is_idling ? 0 : hotend_pid[ee].get_pid_output();
+    float pid_output = is_idling ? 0 : hotend_pid[ee].get_pid_output();
+
+    // a potencia que o boiler vai precisar para os despejos agendados, somada mesmo quando o pid desligaria a resistencia
+    if (ee == 0 && !is_idling && temp_hotend[0].target)
+        pid_output = constrain((hotend_open_loop ? 0 : pid_output) + hotend_feed_forward, 0, PID_MAX);
 
         #if ENABLED(PID_DEBUG)
     if (ee == active_extruder)
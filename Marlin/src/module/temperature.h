@@ -1105,6 +1105,8 @@ public:
 
     // Update the temp manager when PID values change
     #if ENABLED(PIDTEMP)
+    static float hotend_feed_forward; // Added to the PID output of hotend 0 while it has a target, see lucas::Boiler
+    static bool hotend_open_loop;     // While set, hotend 0 is driven by hotend_feed_forward alone, see lucas::Boiler::autotune
     static void updatePID() { TERN_(PID_EXTRUSION_SCALING, pes_e_position = 0); }
     static void setPID(const uint8_t hotend, const_float_t p, const_float_t i, const_float_t d) {
         #if ENABLED(PID_PARAMS_PER_HOTEND)
@@ -0,0 +1,474 @@
+#!/usr/bin/env python3
+#
+# lucas_protocol.py
+# Host side of the protocol of the coffee machine: the '#json#' messages and the binary frames that carry the same commands and events as MessagePack.
+#
+# A frame is  STX | length (u16) | payload | crc (u16),  little endian, the crc being CRC-16/CCITT-FALSE over the length and the payload.
+# The machine always starts writing json. Sending {"cmdSetProtocol": "msgpack"} switches the events to frames, the answer
+# {"infoOther": {"protocol": "msgpack"}} being the last message written as json. Commands are accepted in both at any time.
+# {"cmdSetFlowControl": "credit"} replaces the {"okToReceive": true} every 256 bytes by the credit window described in Connection.
+# A firmware update is verified when {"cmdFirmwareUpdate": {"size": ..., "crc": ..., "resume": ...}} is sent instead of just the size:
+# the image then goes in chunks of FIRMWARE_CHUNK_SIZE bytes, each followed by its crc32, see Connection.upload_firmware.
+#
+# Usage:
+#   python3 lucas_protocol.py /dev/ttyUSB0 '{"reqInfoCalibration": true}' [--json] [--seconds 5]
+#   python3 lucas_protocol.py /dev/ttyUSB0 --firmware Robin_nano_V3.bin [--resume]
+#
+import binascii
+import json
+import struct
+import sys
+import time
+from collections import deque
+
+START_OF_FRAME = 0x02
+MAX_PAYLOAD = 2048
+FIRMWARE_CHUNK_SIZE = 2048
+# without credits the machine answers {"infoOther": {"okToReceive": true}} after this many bytes of a message, and at its end
+ACK_SLICE = 256
+
+def crc16(data):
+    return binascii.crc_hqx(data, 0xFFFF)
+
+def crc32(data):
+    return binascii.crc32(data) & 0xFFFFFFFF
+
+#
+# MessagePack, only what ArduinoJson writes and reads: nil, bool, int, float, str, array and map
+#
+def pack(obj):
+    out = bytearray()
+    _pack(obj, out)
+    return bytes(out)
+
+def _pack(obj, out):
+    if obj is None:
+        out.append(0xC0)
+    elif obj is True:
+        out.append(0xC3)
+    elif obj is False:
+        out.append(0xC2)
+    elif isinstance(obj, int):
+        if 0 <= obj <= 0x7F:
+            out.append(obj)
+        elif -32 <= obj < 0:
+            out.append(obj & 0xFF)
+        elif 0 <= obj <= 0xFF:
+            out += struct.pack('>BB', 0xCC, obj)
+        elif 0 <= obj <= 0xFFFF:
+            out += struct.pack('>BH', 0xCD, obj)
+        elif 0 <= obj <= 0xFFFFFFFF:
+            out += struct.pack('>BI', 0xCE, obj)
+        elif obj > 0:
+            out += struct.pack('>BQ', 0xCF, obj)
+        elif obj >= -0x80:
+            out += struct.pack('>Bb', 0xD0, obj)
+        elif obj >= -0x8000:
+            out += struct.pack('>Bh', 0xD1, obj)
+        elif obj >= -0x80000000:
+            out += struct.pack('>Bi', 0xD2, obj)
+        else:
+            out += struct.pack('>Bq', 0xD3, obj)
+    elif isinstance(obj, float):
+        # the machine only has single precision anyway
+        out += struct.pack('>Bf', 0xCA, obj)
+    elif isinstance(obj, str):
+        data = obj.encode('utf-8')
+        n = len(data)
+        if n <= 31:
+            out.append(0xA0 | n)
+        elif n <= 0xFF:
+            out += struct.pack('>BB', 0xD9, n)
+        elif n <= 0xFFFF:
+            out += struct.pack('>BH', 0xDA, n)
+        else:
+            out += struct.pack('>BI', 0xDB, n)
+        out += data
+    elif isinstance(obj, (list, tuple)):
+        n = len(obj)
+        if n <= 15:
+            out.append(0x90 | n)
+        elif n <= 0xFFFF:
+            out += struct.pack('>BH', 0xDC, n)
+        else:
+            out += struct.pack('>BI', 0xDD, n)
+        for item in obj:
+            _pack(item, out)
+    elif isinstance(obj, dict):
+        n = len(obj)
+        if n <= 15:
+            out.append(0x80 | n)
+        elif n <= 0xFFFF:
+            out += struct.pack('>BH', 0xDE, n)
+        else:
+            out += struct.pack('>BI', 0xDF, n)
+        for key, value in obj.items():
+            _pack(str(key), out)
+            _pack(value, out)
+    else:
+        raise TypeError('can\'t pack %r' % type(obj))
+
+def unpack(data):
+    obj, end = _unpack(data, 0)
+    if end != len(data):
+        raise ValueError('%d bytes left after the object' % (len(data) - end))
+    return obj
+
+_FIXED = {
+    0xCA: '>f', 0xCB: '>d',
+    0xCC: '>B', 0xCD: '>H', 0xCE: '>I', 0xCF: '>Q',
+    0xD0: '>b', 0xD1: '>h', 0xD2: '>i', 0xD3: '>q',
+}
+
+def _unpack(data, i):
+    b = data[i]
+    i += 1
+    if b <= 0x7F:
+        return b, i
+    if b >= 0xE0:
+        return b - 0x100, i
+    if 0x80 <= b <= 0x8F:
+        return _unpack_map(data, i, b & 0x0F)
+    if 0x90 <= b <= 0x9F:
+        return _unpack_array(data, i, b & 0x0F)
+    if 0xA0 <= b <= 0xBF:
+        n = b & 0x1F
+        return data[i:i + n].decode('utf-8'), i + n
+    if b == 0xC0:
+        return None, i
+    if b == 0xC2:
+        return False, i
+    if b == 0xC3:
+        return True, i
+    if b in _FIXED:
+        fmt = _FIXED[b]
+        (value,) = struct.unpack_from(fmt, data, i)
+        return value, i + struct.calcsize(fmt)
+    if b in (0xD9, 0xDA, 0xDB, 0xC4, 0xC5, 0xC6):
+        fmt = {0xD9: '>B', 0xDA: '>H', 0xDB: '>I', 0xC4: '>B', 0xC5: '>H', 0xC6: '>I'}[b]
+        (n,) = struct.unpack_from(fmt, data, i)
+        i += struct.calcsize(fmt)
+        raw = data[i:i + n]
+        return (raw.decode('utf-8') if b >= 0xD9 else bytes(raw)), i + n
+    if b in (0xDC, 0xDD):
+        fmt = '>H' if b == 0xDC else '>I'
+        (n,) = struct.unpack_from(fmt, data, i)
+        return _unpack_array(data, i + struct.calcsize(fmt), n)
+    if b in (0xDE, 0xDF):
+        fmt = '>H' if b == 0xDE else '>I'
+        (n,) = struct.unpack_from(fmt, data, i)
+        return _unpack_map(data, i + struct.calcsize(fmt), n)
+    raise ValueError('unknown messagepack type 0x%02X' % b)
+
+def _unpack_array(data, i, n):
+    items = []
+    for _ in range(n):
+        item, i = _unpack(data, i)
+        items.append(item)
+    return items, i
+
+def _unpack_map(data, i, n):
+    obj = {}
+    for _ in range(n):
+        key, i = _unpack(data, i)
+        value, i = _unpack(data, i)
+        obj[key] = value
+    return obj, i
+
+#
+# Framing
+#
+def encode_frame(payload):
+    if not 0 < len(payload) <= MAX_PAYLOAD:
+        raise ValueError('a frame carries between 1 and %d bytes, not %d' % (MAX_PAYLOAD, len(payload)))
+    header = struct.pack('<H', len(payload))
+    return bytes([START_OF_FRAME]) + header + payload + struct.pack('<H', crc16(header + payload))
+
+def encode_command(obj, binary=True):
+    if binary:
+        return encode_frame(pack(obj))
+    return b'#' + json.dumps(obj, separators=(',', ':')).encode('utf-8') + b'#'
+
+class StreamDecoder:
+    """
+    Splits what the machine writes into ('message', dict) for json messages and frames, ('log', str) for the text lines
+    and ('bad_frame', bytes) for the frames whose crc doesn't match.
+    """
+
+    def __init__(self):
+        self.buffer = bytearray()
+
+    def feed(self, data):
+        self.buffer += data
+        items = []
+        while self.buffer:
+            item = self._next()
+            if item is None:
+                break
+            # the line break after every json message
+            if item != ('log', ''):
+                items.append(item)
+        return items
+
+    def _next(self):
+        b = self.buffer
+        if b[0] == START_OF_FRAME:
+            if len(b) < 3:
+                return None
+            (n,) = struct.unpack_from('<H', b, 1)
+            if n == 0 or n > MAX_PAYLOAD:
+                # not a frame after all
+                del b[0]
+                return ('bad_frame', b'')
+            if len(b) < 3 + n + 2:
+                return None
+            header, payload = bytes(b[1:3]), bytes(b[3:3 + n])
+            (crc,) = struct.unpack_from('<H', b, 3 + n)
+            del b[:3 + n + 2]
+            if crc != crc16(header + payload):
+                return ('bad_frame', payload)
+            return ('message', unpack(payload))
+
+        if b[0] == ord('#'):
+            end = b.find(b'#', 1)
+            if end < 0:
+                return None
+            text = bytes(b[1:end]).decode('utf-8', 'replace')
+            del b[:end + 1]
+            try:
+                return ('message', json.loads(text))
+            except ValueError:
+                return ('log', '#' + text + '#')
+
+        # a line of log, which never has a frame or a message in the middle
+        end = b.find(b'\n')
+        start = min([i for i in (b.find(bytes([START_OF_FRAME])), b.find(b'#')) if i >= 0], default=-1)
+        if start > 0 and (end < 0 or start < end):
+            text = bytes(b[:start])
+            del b[:start]
+            return ('log', text.decode('utf-8', 'replace').strip())
+        if end < 0:
+            return None
+        text = bytes(b[:end])
+        del b[:end + 1]
+        return ('log', text.decode('utf-8', 'replace').strip())
+
+class Connection:
+    """
+    A serial port to the machine, which asks for the binary protocol and for credit flow control, falling back to json and to
+    waiting for an okToReceive every ACK_SLICE bytes if the firmware doesn't know them.
+    With credits the machine advertises, as "rx" at the root of its messages, up to which byte counted from the one right after
+    {"cmdSetFlowControl": "credit"} may be written, and the writes stop there until the edge moves.
+    """
+
+    def __init__(self, port, baud=115200, binary=True, credit=True, timeout=2.0):
+        import serial
+        self.serial = serial.Serial(port, baud, timeout=0.05)
+        self.decoder = StreamDecoder()
+        self.pending = deque()
+        self.binary = False
+        self.credit = False
+        self.sent = 0
+        self.edge = 0
+        # the okToReceive that came and weren't waited for yet, and how many bytes of the current slice were written
+        self.acks = 0
+        self.slice = 0
+        if binary:
+            self.binary = self._negotiate({'cmdSetProtocol': 'msgpack'}, lambda m: m.get('infoOther', {}).get('protocol') == 'msgpack', timeout)
+        if credit:
+            self.credit = self._negotiate({'cmdSetFlowControl': 'credit'}, lambda m: 'rx' in m, timeout)
+        # the ones answering the negotiation don't count
+        self.acks = 0
+        self.timeout = timeout
+
+    def _negotiate(self, command, is_answer, timeout):
+        # the bytes are counted by the machine from the one right after this command
+        self.serial.write(encode_command(command, self.binary))
+        self.sent = 0
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            for item in self._read():
+                kind, value = item
+                if kind == 'message' and is_answer(value):
+                    return True
+                self.pending.append(item)
+        return False
+
+    def _read(self):
+        data = self.serial.read(4096)
+        items = self.decoder.feed(data) if data else []
+        for kind, value in items:
+            if kind == 'message' and 'rx' in value:
+                self.edge = value['rx']
+            if kind == 'message' and value.get('infoOther', {}).get('okToReceive'):
+                self.acks += 1
+        return items
+
+    def credit_left(self):
+        # both counters wrap around at 32 bits
+        left = (self.edge - self.sent) & 0xFFFFFFFF
+        return 0 if left >= 0x80000000 else left
+
+    def _wait_for_ack(self, interrupted):
+        deadline = time.time() + self.timeout
+        while self.acks == 0:
+            if interrupted():
+                return False
+            if time.time() >= deadline:
+                raise RuntimeError('a maquina nao liberou o envio (okToReceive)')
+            self.pending.extend(self._read())
+        self.acks -= 1
+        return True
+
+    def _write_acked(self, data, counted, acked_at_end, interrupted):
+        # only the bytes the machine puts in a buffer count towards the slices, which don't include the end of a message and
+        # the header and crc of a frame
+        start, stop, _ = counted.indices(len(data))
+        view = memoryview(data)
+        position = 0
+        while position < len(data):
+            if position < start:
+                n = start - position
+            elif position < stop:
+                n = min(ACK_SLICE - self.slice, stop - position)
+            else:
+                n = len(data) - position
+            self.serial.write(view[position:position + n])
+            if start <= position < stop:
+                self.slice += n
+                if self.slice == ACK_SLICE:
+                    self.slice = 0
+                    if not self._wait_for_ack(interrupted):
+                        return
+            position += n
+        if acked_at_end:
+            self.slice = 0
+            self._wait_for_ack(interrupted)
+
+    def write(self, data, counted=slice(None), acked_at_end=False, interrupted=lambda: False):
+        """
+        Without credits `counted` is the part of `data` the machine counts towards its okToReceive, and `acked_at_end` whether
+        it sends one more once all of it is received, as it does at the end of a message. `interrupted` stops the writing
+        when the machine won't answer anymore, it's checked against what was received while waiting.
+        """
+        if not self.credit:
+            self._write_acked(data, counted, acked_at_end, interrupted)
+            return
+        view = memoryview(data)
+        while view:
+            n = min(self.credit_left(), len(view))
+            if n == 0:
+                self.pending.extend(self._read())
+                continue
+            self.serial.write(view[:n])
+            self.sent = (self.sent + n) & 0xFFFFFFFF
+            view = view[n:]
+
+    def send(self, obj):
+        # a message counts from its opening '#' up to its closing one, a frame only its payload
+        counted = slice(3, -2) if self.binary else slice(0, -1)
+        self.write(encode_command(obj, self.binary), counted, acked_at_end=True)
+
+    def receive(self):
+        items = list(self.pending) + self._read()
+        self.pending.clear()
+        # the messages that only carry credit are of no interest to anyone else
+        return [(kind, value) for kind, value in items if not (kind == 'message' and list(value) == ['rx'])]
+
+    def _wait_for(self, is_answer, timeout):
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            for kind, value in self.receive():
+                if kind == 'message':
+                    answer = is_answer(value.get('infoFirmware', {}))
+                    if answer is not None:
+                        return answer
+        return None
+
+    def upload_firmware(self, image, resume=False, on_progress=None, timeout=10.0):
+        """
+        Writes a new firmware, verified chunk by chunk and as a whole once it's on the card, after which the machine resets.
+        A rejected chunk is written again, and with resume=True an update of the same image that was cut halfway goes on from
+        the last checkpoint the machine kept.
+        """
+        self.send({'cmdFirmwareUpdate': {'size': len(image), 'crc': crc32(image), 'resume': resume}})
+
+        def offset_or_failure(info):
+            if 'updateFailedCode' in info:
+                raise RuntimeError('falha ao iniciar atualizacao: %r' % info)
+            return info.get('updateOffset')
+
+        offset = self._wait_for(offset_or_failure, timeout)
+        if offset is None:
+            raise RuntimeError('a maquina nao respondeu ao pedido de atualizacao')
+
+        # a rejected chunk is discarded without any okToReceive
+        def chunk_rejected():
+            return any(kind == 'message' and 'updateChunkRejected' in value.get('infoFirmware', {}) for kind, value in self.pending)
+
+        while offset < len(image):
+            chunk = image[offset:offset + FIRMWARE_CHUNK_SIZE]
+            self.write(chunk + struct.pack('<I', crc32(chunk)), interrupted=chunk_rejected)
+
+            rejected = None
+            for kind, value in self.receive():
+                info = value.get('infoFirmware', {}) if kind == 'message' else {}
+                if 'updateFailedCode' in info:
+                    raise RuntimeError('atualizacao falhou: %r' % info)
+                if 'updateChunkRejected' in info:
+                    rejected = info['updateChunkRejected']
+                if 'updateProgress' in info and on_progress:
+                    on_progress(info['updateProgress'])
+
+            if rejected is None:
+                offset += len(chunk)
+                continue
+
+            # whatever was written after the bad chunk is thrown away until the port goes quiet for a bit
+            # and the machine counts the slices again from the chunk written again
+            time.sleep(0.2)
+            self.receive()
+            self.acks = 0
+            self.slice = 0
+            offset = rejected
+
+        def done(info):
+            if 'updateFailedCode' in info:
+                raise RuntimeError('atualizacao falhou: %r' % info)
+            if on_progress and 'updateProgress' in info:
+                on_progress(info['updateProgress'])
+            return True if info.get('updateProgress', 0) >= 1 else None
+
+        if not self._wait_for(done, timeout):
+            raise RuntimeError('a maquina nao confirmou o fim da atualizacao')
+
+def main(argv):
+    import argparse
+    parser = argparse.ArgumentParser(description='Sends a command to the machine and prints what comes back')
+    parser.add_argument('port')
+    parser.add_argument('command', nargs='?', help='the command as json, e.g. \'{"reqInfoCalibration": true}\'')
+    parser.add_argument('--firmware', help='writes this image as the new firmware instead of sending a command')
+    parser.add_argument('--resume', action='store_true', help='goes on from where the last update of the same image stopped')
+    parser.add_argument('--json', action='store_true', help='don\'t ask for the binary protocol')
+    parser.add_argument('--no-credit', action='store_true', help='don\'t ask for credit flow control')
+    parser.add_argument('--seconds', type=float, default=5.0)
+    args = parser.parse_args(argv)
+
+    connection = Connection(args.port, binary=not args.json, credit=not args.no_credit)
+    print('protocolo: %s | controle de fluxo: %s' % ('msgpack' if connection.binary else 'json', 'credito' if connection.credit else 'nenhum'))
+    if args.firmware:
+        with open(args.firmware, 'rb') as f:
+            image = f.read()
+        connection.upload_firmware(image, resume=args.resume, on_progress=lambda p: print('progresso: %.0f%%' % (p * 100)))
+        print('firmware enviado, a maquina vai reiniciar')
+        return
+    if not args.command:
+        parser.error('a command or --firmware is needed')
+    connection.send(json.loads(args.command))
+    deadline = time.time() + args.seconds
+    while time.time() < deadline:
+        for kind, value in connection.receive():
+            print(kind, json.dumps(value) if kind == 'message' else value)
+
+if __name__ == '__main__':
+    main(sys.argv[1:])